@@ -1,12 +1,21 @@
 "use client"
 
 import { useState, useEffect } from "react"
-import { HistoryItem } from "@/lib/types"
+import { HistoryItem, ExportFormat } from "@/lib/types"
+
+const EXPORT_FORMATS: { format: ExportFormat; label: string; extension: string }[] = [
+  { format: "jpeg", label: "JPEG", extension: "jpg" },
+  { format: "png", label: "PNG (16-bit)", extension: "png" },
+  { format: "tiff", label: "TIFF (16-bit)", extension: "tif" },
+]
 
 interface ExportDialogProps {
   isOpen: boolean
   onClose: () => void
   history: HistoryItem[]
+  // Full-size file of a version in format; null skips it. Without it
+  // only JPEG exports, from the stored preview.
+  renderItem?: (item: HistoryItem, format: ExportFormat) => Promise<Blob | null>
   currentImageData: ImageData | null
   currentParams: any
 }
@@ -15,12 +24,14 @@ export default function ExportDialog({
   isOpen,
   onClose,
   history,
+  renderItem,
   currentImageData,
   currentParams
 }: ExportDialogProps) {
   const [selectedItems, setSelectedItems] = useState<string[]>([])
   const [isExporting, setIsExporting] = useState(false)
   const [includeSettings, setIncludeSettings] = useState(true)
+  const [format, setFormat] = useState<ExportFormat>("jpeg")
 
   useEffect(() => {
     if (!isOpen) {
@@ -54,20 +65,29 @@ export default function ExportDialog({
 
     try {
       const selectedHistoryItems = history.filter(item => selectedItems.includes(item.id))
+      const { extension } = EXPORT_FORMATS.find(f => f.format === format)!
       
       for (const item of selectedHistoryItems) {
+        const blob = renderItem ? await renderItem(item, format) : null
+        const url = blob ? URL.createObjectURL(blob) : format === "jpeg" ? item.previewUrl : null
+        if (!url) {
+          console.warn(`Skipped version ${item.id}: no ${format.toUpperCase()} encoder`)
+          continue
+        }
+        
         // Create a link element to download the image
         const link = document.createElement('a')
-        link.href = item.jpegDataUrl
+        link.href = url
         
         // Generate filename with timestamp and index
         const timestamp = new Date(item.timestamp).toISOString().replace(/[:.]/g, '-')
         const index = history.findIndex(h => h.id === item.id)
-        link.download = `processed_${timestamp}_v${history.length - index}.jpg`
+        link.download = `processed_${timestamp}_v${history.length - index}.${extension}`
         
         document.body.appendChild(link)
         link.click()
         document.body.removeChild(link)
+        if (blob) URL.revokeObjectURL(url)
         
         // Small delay between downloads to avoid browser blocking
         await new Promise(resolve => setTimeout(resolve, 100))
@@ -148,7 +168,7 @@ export default function ExportDialog({
               />
               
               <img
-                src={item.jpegDataUrl}
+                src={item.previewUrl ?? undefined}
                 alt={`Version ${history.length - index}`}
                 className="w-16 h-16 object-cover rounded mr-3"
               />
@@ -171,6 +191,18 @@ export default function ExportDialog({
         </div>
 
         <div className="mb-4">
+          <label className="flex items-center text-gray-300 mb-2">
+            <span className="mr-2">Format</span>
+            <select
+              value={format}
+              onChange={(e) => setFormat(e.target.value as ExportFormat)}
+              className="bg-gray-700 text-white rounded px-2 py-1"
+            >
+              {EXPORT_FORMATS.map(f => (
+                <option key={f.format} value={f.format}>{f.label}</option>
+              ))}
+            </select>
+          </label>
           <label className="flex items-center text-gray-300">
             <input
               type="checkbox"
@@ -67,4 +67,41 @@ describe('Histogram', () => {
     // Canvas should still be there
     expect(container.querySelector('canvas')).toBeInTheDocument()
   })
-})
\ No newline at end of file
+
+  it('should draw the histogram computed with the render without scanning pixels', () => {
+    const ctx = {
+      clearRect: vi.fn(),
+      fillRect: vi.fn(),
+      beginPath: vi.fn(),
+      moveTo: vi.fn(),
+      lineTo: vi.fn(),
+      closePath: vi.fn(),
+      fill: vi.fn(),
+      stroke: vi.fn(),
+    }
+    vi.spyOn(HTMLCanvasElement.prototype, 'getContext').mockReturnValue(ctx as any)
+    
+    // All red at 200; the (black) pixels themselves say otherwise
+    const histogram = new Uint32Array(4 * 256)
+    histogram[200] = 100
+    const analysis = {
+      histogram,
+      linearHistogram: new Uint32Array(3 * 256),
+      clipMasks: null,
+      mean: [200, 0, 0, 47],
+      p1: [200, 0, 0, 47],
+      median: [200, 0, 0, 47],
+      p99: [200, 0, 0, 47],
+      highlightClipped: [0, 0, 0],
+      shadowClipped: [0, 100, 100],
+    }
+    render(<Histogram imageData={new ImageData(10, 10)} analysis={analysis} />)
+    
+    // Full bar (90% of 80px) at bin 200
+    expect(ctx.lineTo).toHaveBeenCalledWith(200, 8)
+    // Shadow indicator only
+    expect(ctx.moveTo).toHaveBeenCalledWith(0, 0)
+    expect(ctx.moveTo).not.toHaveBeenCalledWith(256, 0)
+    vi.restoreAllMocks()
+  })
+})
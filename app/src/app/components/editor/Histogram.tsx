@@ -1,12 +1,16 @@
 "use client"
 
 import { useEffect, useRef } from "react"
+import { ImageAnalysis } from "@/lib/types"
 
 interface HistogramProps {
   imageData: ImageData | null
+  // Histograms computed with the render; without them the pixels are
+  // scanned here (mock processor, older builds)
+  analysis?: ImageAnalysis | null
 }
 
-export default function Histogram({ imageData }: HistogramProps) {
+export default function Histogram({ imageData, analysis = null }: HistogramProps) {
   const canvasRef = useRef<HTMLCanvasElement>(null)
 
   useEffect(() => {
@@ -16,27 +20,39 @@ export default function Histogram({ imageData }: HistogramProps) {
     const ctx = canvas.getContext("2d")
     if (!ctx) return
     
-    // Calculate histogram data
-    const redChannel = new Array(256).fill(0)
-    const greenChannel = new Array(256).fill(0)
-    const blueChannel = new Array(256).fill(0)
+    let redChannel: ArrayLike<number>
+    let greenChannel: ArrayLike<number>
+    let blueChannel: ArrayLike<number>
     
-    const data = imageData.data
-    for (let i = 0; i < data.length; i += 4) {
-      const r = data[i]
-      const g = data[i + 1]
-      const b = data[i + 2]
-      if (r !== undefined) redChannel[r]++
-      if (g !== undefined) greenChannel[g]++
-      if (b !== undefined) blueChannel[b]++
+    if (analysis) {
+      redChannel = analysis.histogram.subarray(0, 256)
+      greenChannel = analysis.histogram.subarray(256, 512)
+      blueChannel = analysis.histogram.subarray(512, 768)
+    } else {
+      // Calculate histogram data
+      const red = new Array(256).fill(0)
+      const green = new Array(256).fill(0)
+      const blue = new Array(256).fill(0)
+      
+      const data = imageData.data
+      for (let i = 0; i < data.length; i += 4) {
+        const r = data[i]
+        const g = data[i + 1]
+        const b = data[i + 2]
+        if (r !== undefined) red[r]++
+        if (g !== undefined) green[g]++
+        if (b !== undefined) blue[b]++
+      }
+      redChannel = red
+      greenChannel = green
+      blueChannel = blue
     }
     
     // Find max value for scaling
-    const maxValue = Math.max(
-      ...redChannel,
-      ...greenChannel,
-      ...blueChannel
-    )
+    let maxValue = 0
+    for (let i = 0; i < 256; i++) {
+      maxValue = Math.max(maxValue, redChannel[i], greenChannel[i], blueChannel[i])
+    }
     
     // Clear canvas
     ctx.clearRect(0, 0, canvas.width, canvas.height)
@@ -103,7 +119,29 @@ export default function Histogram({ imageData }: HistogramProps) {
       ctx.lineTo(x, height)
       ctx.stroke()
     }
-  }, [imageData])
+    
+    // Clipping indicators: shadows top left, highlights top right
+    if (analysis) {
+      const clipped = (counts: number[]) => counts.some(count => count > 0)
+      ctx.fillStyle = "rgba(255, 255, 255, 0.8)"
+      if (clipped(analysis.shadowClipped)) {
+        ctx.beginPath()
+        ctx.moveTo(0, 0)
+        ctx.lineTo(8, 0)
+        ctx.lineTo(0, 8)
+        ctx.closePath()
+        ctx.fill()
+      }
+      if (clipped(analysis.highlightClipped)) {
+        ctx.beginPath()
+        ctx.moveTo(canvas.width, 0)
+        ctx.lineTo(canvas.width - 8, 0)
+        ctx.lineTo(canvas.width, 8)
+        ctx.closePath()
+        ctx.fill()
+      }
+    }
+  }, [imageData, analysis])
 
   return (
     <div className="h-full flex items-center justify-center">
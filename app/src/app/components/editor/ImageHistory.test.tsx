@@ -29,22 +29,28 @@ describe('ImageHistory', () => {
   const mockHistory = [
     {
       id: '1',
-      imageData: null,
-      jpegDataUrl: 'data:image/jpeg;base64,test1',
+      delta: { exposure: 1 },
+      previewUrl: 'data:image/jpeg;base64,test1',
+      width: 100,
+      height: 100,
       params: { ...mockParams, exposure: 1 },
       timestamp: new Date(Date.now() - 1000)
     },
     {
       id: '2',
-      imageData: null,
-      jpegDataUrl: 'data:image/jpeg;base64,test2',
+      delta: { exposure: 2 },
+      previewUrl: 'data:image/jpeg;base64,test2',
+      width: 100,
+      height: 100,
       params: { ...mockParams, exposure: 2 },
       timestamp: new Date(Date.now() - 2000)
     },
     {
       id: '3',
-      imageData: null,
-      jpegDataUrl: 'data:image/jpeg;base64,test3',
+      delta: { exposure: 3 },
+      previewUrl: 'data:image/jpeg;base64,test3',
+      width: 100,
+      height: 100,
       params: { ...mockParams, exposure: 3 },
       timestamp: new Date(Date.now() - 3000)
     }
@@ -1,22 +1,14 @@
 "use client"
 
 import { useState } from "react"
-import { EditParams } from "@/lib/types"
-
-interface ImageHistoryItem {
-  id: string
-  imageData: ImageData | null
-  jpegDataUrl: string | null
-  params: EditParams
-  timestamp: Date
-}
+import { HistoryItem } from "@/lib/types"
 
 interface ImageHistoryProps {
-  history: ImageHistoryItem[]
-  onRestore: (item: ImageHistoryItem) => void
+  history: HistoryItem[]
+  onRestore: (item: HistoryItem) => void
   currentImageData: ImageData | null
-  onCompare?: (item: ImageHistoryItem) => void
-  onCompareTwoItems?: (item1: ImageHistoryItem, item2: ImageHistoryItem) => void
+  onCompare?: (item: HistoryItem) => void
+  onCompareTwoItems?: (item1: HistoryItem, item2: HistoryItem) => void
   mode?: 'single' | 'compare'
   onModeChange?: (mode: 'single' | 'compare') => void
   selectedIndex?: number
@@ -65,9 +57,9 @@ export default function ImageHistory({
       } else {
         setInternalSelection(newSelection)
       }
-      // Immediately show the cached image
+      // Show the version right away; evicted renders are redone from params
       const item = history[index]
-      if (item && item.jpegDataUrl) {
+      if (item) {
         onRestore(item)
       }
     } else {
@@ -165,9 +157,9 @@ export default function ImageHistory({
               <div 
                 className="w-20 h-15 bg-gray-700 rounded overflow-hidden"
               >
-                {item.jpegDataUrl ? (
+                {item.previewUrl ? (
                   <img 
-                    src={item.jpegDataUrl} 
+                    src={item.previewUrl} 
                     alt={`History ${index + 1}`}
                     className="w-full h-full object-cover"
                   />
@@ -1,6 +1,7 @@
 "use client"
 
 import { useEffect, useRef, useState, useCallback } from "react"
+import { ImageRegion, RegionImage } from "@/lib/types"
 
 interface ImageViewerProps {
   imageData: ImageData | null
@@ -8,6 +9,15 @@ interface ImageViewerProps {
   currentComparisonData?: ImageData | null
   showComparison?: boolean
   isProcessing: boolean
+  // >1 while imageData is a reduced-resolution preview of the render in
+  // progress: it is drawn at full size and the view stays interactive
+  previewScale?: number
+  // Region render drawn over imageData at its place, e.g. the visible part
+  // at full resolution with newer settings
+  detail?: RegionImage | null
+  // Visible part of the image in full-size pixels while zoomed to 1:1 or
+  // closer and not dragging, null otherwise
+  onViewportChange?: (region: ImageRegion | null) => void
 }
 
 export default function ImageViewer({ 
@@ -15,10 +25,14 @@ export default function ImageViewer({
   previousImageData,
   currentComparisonData,
   showComparison = false,
-  isProcessing 
+  isProcessing,
+  previewScale = 1,
+  detail = null,
+  onViewportChange
 }: ImageViewerProps) {
   const canvasRef = useRef<HTMLCanvasElement>(null)
   const previousCanvasRef = useRef<HTMLCanvasElement>(null)
+  const detailCanvasRef = useRef<HTMLCanvasElement>(null)
   const containerRef = useRef<HTMLDivElement>(null)
   const [zoom, setZoom] = useState(1)
   const [pan, setPan] = useState({ x: 0, y: 0 })
@@ -28,6 +42,8 @@ export default function ImageViewer({
   
   // Use currentComparisonData for "after" image if available, otherwise use imageData
   const afterImageData = currentComparisonData || imageData
+  const afterScale = currentComparisonData ? 1 : previewScale
+  const isPreview = isProcessing && afterScale > 1 && !!afterImageData
   
   // Helper function to draw ImageData to canvas
   const drawToCanvas = useCallback((canvas: HTMLCanvasElement | null, data: ImageData | null) => {
@@ -36,10 +52,14 @@ export default function ImageViewer({
     const ctx = canvas.getContext("2d")
     if (!ctx) return
     
-    // Set canvas size to match image
-    canvas.width = data.width
-    canvas.height = data.height
-    
+    // Set canvas size to match image. Assigning it reallocates the canvas
+    // even when the size is the same, which previews of one size would do
+    // for every frame.
+    if (canvas.width !== data.width || canvas.height !== data.height) {
+      canvas.width = data.width
+      canvas.height = data.height
+    }
+
     // Draw image data
     ctx.putImageData(data, 0, 0)
   }, [])
@@ -55,6 +75,11 @@ export default function ImageViewer({
     drawToCanvas(canvas, previousImageData ?? null)
   }, [previousImageData, drawToCanvas])
   
+  const detailCanvasCallback = useCallback((canvas: HTMLCanvasElement | null) => {
+    detailCanvasRef.current = canvas
+    drawToCanvas(canvas, detail?.image ?? null)
+  }, [detail, drawToCanvas])
+  
 
   // Re-draw when data changes
   useEffect(() => {
@@ -66,6 +91,35 @@ export default function ImageViewer({
     drawToCanvas(previousCanvasRef.current, previousImageData ?? null)
   }, [previousImageData, drawToCanvas])
   
+  // Report the visible rectangle once zoom and pan settle. The image is
+  // centered, shifted by pan and scaled by zoom around its center.
+  const lastViewportRef = useRef<string | null>(null)
+  useEffect(() => {
+    if (!onViewportChange) return
+    
+    let viewport: ImageRegion | null = null
+    const container = containerRef.current
+    if (container && afterImageData && !showComparison && !isDragging && zoom >= 1) {
+      const imageWidth = afterImageData.width * afterScale
+      const imageHeight = afterImageData.height * afterScale
+      const toImage = (screen: number, size: number, offset: number, extent: number) =>
+        Math.max(0, Math.min(extent, (screen - size / 2 - offset) / zoom + extent / 2))
+      const left = Math.floor(toImage(0, container.clientWidth, pan.x, imageWidth))
+      const top = Math.floor(toImage(0, container.clientHeight, pan.y, imageHeight))
+      const right = Math.ceil(toImage(container.clientWidth, container.clientWidth, pan.x, imageWidth))
+      const bottom = Math.ceil(toImage(container.clientHeight, container.clientHeight, pan.y, imageHeight))
+      if (right > left && bottom > top) {
+        viewport = { x: left, y: top, width: right - left, height: bottom - top }
+      }
+    }
+    
+    const key = JSON.stringify(viewport)
+    if (key !== lastViewportRef.current) {
+      lastViewportRef.current = key
+      onViewportChange(viewport)
+    }
+  }, [onViewportChange, afterImageData, afterScale, showComparison, isDragging, zoom, pan])
+  
 
   // Handle wheel events with native listener to prevent passive event issues
   useEffect(() => {
@@ -107,14 +161,16 @@ export default function ImageViewer({
     const containerWidth = container.clientWidth
     const containerHeight = container.clientHeight
     
-    const imageAspect = afterImageData.width / afterImageData.height
+    const imageWidth = afterImageData.width * afterScale
+    const imageHeight = afterImageData.height * afterScale
+    const imageAspect = imageWidth / imageHeight
     const containerAspect = containerWidth / containerHeight
     
     let newZoom
     if (imageAspect > containerAspect) {
-      newZoom = containerWidth / afterImageData.width
+      newZoom = containerWidth / imageWidth
     } else {
-      newZoom = containerHeight / afterImageData.height
+      newZoom = containerHeight / imageHeight
     }
     
     setZoom(newZoom * 0.9) // 90% to add some padding
@@ -130,7 +186,14 @@ export default function ImageViewer({
       onMouseUp={handleMouseUp}
       onMouseLeave={handleMouseUp}
     >
-      {isProcessing && (
+      {isPreview && (
+        <div className="absolute top-4 left-4 z-10 flex items-center space-x-2 bg-gray-800 bg-opacity-80 rounded-lg px-3 py-2 text-white text-sm">
+          <div className="w-3 h-3 border-2 border-white border-t-transparent rounded-full animate-spin" />
+          <span>Rendering full quality...</span>
+        </div>
+      )}
+      
+      {isProcessing && !isPreview && (
         <div className="absolute inset-0 flex items-center justify-center bg-black bg-opacity-50 z-10">
           <div className="text-white text-center">
             <div className="w-16 h-16 border-4 border-white border-t-transparent rounded-full animate-spin mx-auto mb-4" />
@@ -180,8 +243,8 @@ export default function ImageViewer({
                 ref={mainCanvasCallback}
                 className="shadow-2xl block"
                 style={{
-                  width: `${(currentComparisonData || afterImageData)?.width || 1}px`,
-                  height: `${(currentComparisonData || afterImageData)?.height || 1}px`,
+                  width: `${(afterImageData?.width || 1) * afterScale}px`,
+                  height: `${(afterImageData?.height || 1) * afterScale}px`,
                   imageRendering: zoom > 1.5 ? "pixelated" : "auto",
                 }}
               />
@@ -223,17 +286,31 @@ export default function ImageViewer({
             transform: `translate(${pan.x}px, ${pan.y}px)`,
           }}
         >
-          <canvas
-            ref={mainCanvasCallback}
-            className="shadow-2xl block"
-            style={{
-              width: `${afterImageData?.width || 1}px`,
-              height: `${afterImageData?.height || 1}px`,
-              transform: `scale(${zoom})`,
-              transformOrigin: "center",
-              imageRendering: zoom > 1.5 ? "pixelated" : "auto",
-            }}
-          />
+          <div className="relative" style={{ transform: `scale(${zoom})`, transformOrigin: "center" }}>
+            <canvas
+              ref={mainCanvasCallback}
+              className="shadow-2xl block"
+              style={{
+                width: `${(afterImageData?.width || 1) * afterScale}px`,
+                height: `${(afterImageData?.height || 1) * afterScale}px`,
+                imageRendering: zoom > 1.5 ? "pixelated" : "auto",
+              }}
+            />
+            {detail && zoom >= 1 && (
+              <canvas
+                ref={detailCanvasCallback}
+                data-testid="detail-canvas"
+                className="absolute block"
+                style={{
+                  left: `${detail.region.x}px`,
+                  top: `${detail.region.y}px`,
+                  width: `${detail.region.width}px`,
+                  height: `${detail.region.height}px`,
+                  imageRendering: zoom > 1.5 ? "pixelated" : "auto",
+                }}
+              />
+            )}
+          </div>
         </div>
       ) : null}
       
@@ -16,6 +16,18 @@ describe('ImageViewer', () => {
     expect(screen.getByText(/Processing RAW file/i)).toBeInTheDocument()
   })
 
+  it('keeps a preview visible while the full render runs', () => {
+    const preview = new ImageData(50, 50)
+    const { container } = render(<ImageViewer imageData={preview} isProcessing={true} previewScale={2} />)
+    
+    expect(screen.queryByText(/Processing RAW file/i)).not.toBeInTheDocument()
+    expect(screen.getByText(/Rendering full quality/i)).toBeInTheDocument()
+    
+    const canvas = container.querySelector('canvas') as HTMLCanvasElement
+    expect(canvas.style.width).toBe('100px')
+    expect(canvas.style.height).toBe('100px')
+  })
+
   it('renders canvas when image data is provided', () => {
     const { container } = render(<ImageViewer imageData={mockImageData} isProcessing={false} />)
     const canvas = container.querySelector('canvas')
@@ -58,4 +70,27 @@ describe('ImageViewer', () => {
     expect(screen.getByText('+')).toBeInTheDocument()
     expect(screen.getByText('-')).toBeInTheDocument()
   })
-})
\ No newline at end of file
+
+  it('draws a region render over the image at its place', () => {
+    const detail = { image: new ImageData(20, 10), region: { x: 30, y: 40, width: 20, height: 10 } }
+    render(<ImageViewer imageData={mockImageData} isProcessing={false} detail={detail} />)
+    
+    const canvas = screen.getByTestId('detail-canvas') as HTMLCanvasElement
+    expect(canvas.style.left).toBe('30px')
+    expect(canvas.style.top).toBe('40px')
+    expect(canvas.style.width).toBe('20px')
+    expect(canvas.style.height).toBe('10px')
+  })
+
+  it('reports the visible part of the image at 1:1', () => {
+    vi.spyOn(HTMLElement.prototype, 'clientWidth', 'get').mockReturnValue(40)
+    vi.spyOn(HTMLElement.prototype, 'clientHeight', 'get').mockReturnValue(20)
+    const onViewportChange = vi.fn()
+    
+    render(<ImageViewer imageData={mockImageData} isProcessing={false} onViewportChange={onViewportChange} />)
+    
+    // 40x20 window centered on a 100x100 image
+    expect(onViewportChange).toHaveBeenLastCalledWith({ x: 30, y: 40, width: 40, height: 20 })
+    vi.restoreAllMocks()
+  })
+})
@@ -33,6 +33,7 @@ vi.mock('@/lib/hooks/useLibRaw', () => ({
 
 vi.mock('@/lib/utils/image-utils', () => ({
   imageDataToJpeg: vi.fn().mockResolvedValue('data:image/jpeg;base64,mockjpeg'),
+  imageDataToBlob: vi.fn().mockResolvedValue(new Blob(['mockjpeg'], { type: 'image/jpeg' })),
   jpegToImageData: vi.fn().mockResolvedValue(new ImageData(100, 100))
 }))
 
@@ -1,6 +1,6 @@
 "use client"
 
-import { useState, useEffect, useRef, useCallback } from "react"
+import { useState, useEffect, useRef, useCallback, useMemo } from "react"
 import { useParams, useRouter } from "next/navigation"
 import ImageViewer from "@/app/components/editor/ImageViewer"
 import Histogram from "@/app/components/editor/Histogram"
@@ -9,10 +9,18 @@ import AdvancedAdjustments from "@/app/components/editor/AdvancedAdjustments"
 import ComparisonDebugger from "@/app/components/editor/ComparisonDebugger"
 import ImageHistory from "@/app/components/editor/ImageHistory"
 import ExportDialog from "@/app/components/editor/ExportDialog"
-import { EditParams } from "@/lib/types"
+import { EditParams, ExportFormat, HistoryEntry, HistoryItem, ImageRegion } from "@/lib/types"
 import { usePhotosStore } from "@/lib/store/photos"
 import { useLibRaw } from "@/lib/hooks/useLibRaw"
-import { imageDataToJpeg, jpegToImageData } from "@/lib/utils/image-utils"
+import { imageDataToBlob, imageDataToJpeg, jpegToImageData } from "@/lib/utils/image-utils"
+import { HISTORY_PREVIEW_SIZE, RenderCache, paramsDelta, resolveHistory } from "@/lib/utils/edit-history"
+
+// Parameters that move pixels; a region render can't show their changes
+function sameGeometry(a: EditParams, b: EditParams): boolean {
+  return (a.userFlip || 0) === (b.userFlip || 0) &&
+    !!a.cropEnabled === !!b.cropEnabled &&
+    JSON.stringify(a.cropArea) === JSON.stringify(b.cropArea)
+}
 
 export default function EditorPage() {
   const { id } = useParams() as { id: string }
@@ -47,24 +55,31 @@ export default function EditorPage() {
     outputBPS: 8,
   })
   
-  const { loadFile, process, imageData, metadata, thumbnail, isLoading, isProcessing, error } = useLibRaw()
+  const { loadFile, process, renderRegion, renderImage, encodeImage, imageData, analysis, detail, metadata, thumbnail, isLoading, isProcessing, isPreview, previewScale, error } = useLibRaw()
+  // While only the preview is up, a new Process supersedes the running render
+  const isBusy = isLoading || (isProcessing && !isPreview)
   const loadedFileRef = useRef<File | null>(null)
   const [hasUnsavedChanges, setHasUnsavedChanges] = useState(false)
   const [lastProcessedParams, setLastProcessedParams] = useState<EditParams | null>(null)
   const [previousImageData, setPreviousImageData] = useState<ImageData | null>(null)
   const [currentComparisonData, setCurrentComparisonData] = useState<ImageData | null>(null)
-  const [imageHistory, setImageHistory] = useState<Array<{
-    id: string
-    imageData: ImageData | null
-    jpegDataUrl: string | null
-    params: EditParams
-    timestamp: Date
-  }>>([])
+  // History stores parameter deltas and small previews; full renders of
+  // recent versions are in renderCache and evicted ones are rendered again
+  const [historyEntries, setHistoryEntries] = useState<HistoryEntry[]>([])
+  const imageHistory = useMemo(() => resolveHistory(historyEntries), [historyEntries])
+  const renderCacheRef = useRef(new RenderCache())
+  // Version the viewer is switching to, so that a slower render of an
+  // earlier selection does not replace it
+  const restoringIdRef = useRef<string | null>(null)
   const [displayImageData, setDisplayImageData] = useState<ImageData | null>(null)
+  // >1 while displayImageData is the stored preview of a history version
+  const [displayScale, setDisplayScale] = useState(1)
   const [historyMode, setHistoryMode] = useState<'single' | 'compare'>('single')
   const [historySelection, setHistorySelection] = useState<number[]>([])
   const [showExportDialog, setShowExportDialog] = useState(false)
   const [shouldAddToHistory, setShouldAddToHistory] = useState(false)
+  // Visible part of the image while zoomed to 1:1 or closer
+  const [viewport, setViewport] = useState<ImageRegion | null>(null)
   const previousIsProcessingRef = useRef(false)
   
   // Use refs for immediate access in event handlers
@@ -94,6 +109,7 @@ export default function EditorPage() {
   useEffect(() => {
     if (imageData) {
       setDisplayImageData(imageData)
+      setDisplayScale(1)
     }
   }, [imageData])
   
@@ -103,22 +119,24 @@ export default function EditorPage() {
     if (previousIsProcessingRef.current && !isProcessing && shouldAddToHistory && imageData && lastProcessedParams) {
       const addToHistory = async () => {
         try {
-          const jpegDataUrl = await imageDataToJpeg(imageData)
+          const previewUrl = await imageDataToJpeg(imageData, HISTORY_PREVIEW_SIZE)
+          const id = Date.now().toString()
+          renderCacheRef.current.set(id, imageData)
           
-          setImageHistory(prev => {
-            // Add new history item
-            const newHistory = [{
-              id: Date.now().toString(),
-              imageData: null,
-              jpegDataUrl: jpegDataUrl,
-              params: { ...lastProcessedParams }, // Clone to avoid reference issues
+          setHistoryEntries(prev => {
+            // Add new history item with what changed since the newest one
+            const newest = prev.length > 0 ? resolveHistory(prev)[0].params : null
+            return [{
+              id,
+              delta: paramsDelta(newest, lastProcessedParams),
+              previewUrl,
+              width: imageData.width,
+              height: imageData.height,
               timestamp: new Date()
             }, ...prev]
-            
-            return newHistory
           })
         } catch (err) {
-          console.error('Failed to cache image as JPEG:', err)
+          console.error('Failed to cache image preview as JPEG:', err)
         } finally {
           // Reset the flag
           setShouldAddToHistory(false)
@@ -134,13 +152,14 @@ export default function EditorPage() {
   
   // Manual processing function
   const handleProcess = useCallback(async () => {
-    if (!photo?.file || isLoading || isProcessing) return
+    if (!photo?.file || isBusy) return
     
     setShouldAddToHistory(true) // Mark that we want to add to history when done
+    restoringIdRef.current = null
     process(editParams)
     setLastProcessedParams({ ...editParams }) // Clone to avoid reference issues
     setHasUnsavedChanges(false)
-  }, [photo?.file, isLoading, isProcessing, process, editParams])
+  }, [photo?.file, isBusy, process, editParams])
   
   // Check if parameters have changed
   useEffect(() => {
@@ -149,6 +168,17 @@ export default function EditorPage() {
     }
   }, [editParams, lastProcessedParams])
 
+  // Zoomed in, unprocessed changes show up on the visible part right away:
+  // a region render reuses the cached demosaic and only converts what is on
+  // screen, and panning renders just the newly visible region. Process
+  // still renders the whole frame.
+  useEffect(() => {
+    if (!viewport || !hasUnsavedChanges || !lastProcessedParams) return
+    if (isProcessing || isLoading || historyMode === 'compare') return
+    if (!sameGeometry(editParams, lastProcessedParams)) return
+    renderRegion(editParams, viewport)
+  }, [viewport, editParams, hasUnsavedChanges, lastProcessedParams, isProcessing, isLoading, historyMode, renderRegion])
+
   // Update crop area when metadata is loaded
   useEffect(() => {
     if (metadata && !editParams.cropArea) {
@@ -167,94 +197,103 @@ export default function EditorPage() {
     }))
   }
   
+  // Full render of a history version: cached, or rendered again, which
+  // only reruns the color stages while the worker has the demosaic cached
+  const renderHistoryItem = useCallback(async (item: HistoryItem): Promise<ImageData | null> => {
+    const cached = renderCacheRef.current.get(item.id)
+    if (cached) return cached
+    
+    const image = await renderImage(item.params)
+    if (image) renderCacheRef.current.set(item.id, image)
+    return image
+  }, [renderImage])
+  
   // Restore from history
-  const handleRestoreFromHistory = useCallback(async (item: {
-    id: string
-    imageData: ImageData | null
-    jpegDataUrl: string | null
-    params: EditParams
-    timestamp: Date
-  }) => {
-    // If we have cached JPEG, show it immediately without re-processing
-    if (item.jpegDataUrl) {
-      try {
-        const restoredImageData = await jpegToImageData(item.jpegDataUrl)
-        setDisplayImageData(restoredImageData)
-        // Clear any comparison state in single mode
-        if (historyMode === 'single') {
-          setPreviousImageData(null)
-          setCurrentComparisonData(null)
+  const handleRestoreFromHistory = useCallback(async (item: HistoryItem) => {
+    restoringIdRef.current = item.id
+    // Clear any comparison state in single mode
+    if (historyMode === 'single') {
+      setPreviousImageData(null)
+      setCurrentComparisonData(null)
+    }
+    // Update edit params to match
+    setEditParams(item.params)
+    setLastProcessedParams(item.params)
+    setHasUnsavedChanges(false)
+    
+    const cached = renderCacheRef.current.get(item.id)
+    if (cached) {
+      setDisplayImageData(cached)
+      setDisplayScale(1)
+      return
+    }
+    
+    try {
+      // The stored preview stands in until the render arrives
+      if (item.previewUrl) {
+        const preview = await jpegToImageData(item.previewUrl)
+        if (restoringIdRef.current === item.id) {
+          setDisplayImageData(preview)
+          setDisplayScale(item.width / preview.width)
         }
-        // Update edit params to match
-        setEditParams(item.params)
-        setLastProcessedParams(item.params)
-        setHasUnsavedChanges(false)
-      } catch (err) {
-        console.error('Failed to restore from JPEG cache:', err)
-        // Fall back to re-processing if cache fails
-        process(item.params)
       }
-    } else {
-      // No cache, need to re-process
+      const image = await renderHistoryItem(item)
+      if (image && restoringIdRef.current === item.id) {
+        setDisplayImageData(image)
+        setDisplayScale(1)
+      }
+    } catch (err) {
+      console.error('Failed to restore history version:', err)
+      // Fall back to a regular render
       process(item.params)
     }
-  }, [process, historyMode])
+  }, [process, historyMode, renderHistoryItem])
   
   // Compare with history item
-  const handleCompareWithHistory = useCallback(async (item: {
-    id: string
-    imageData: ImageData | null
-    jpegDataUrl: string | null
-    params: EditParams
-    timestamp: Date
-  }) => {
-    // Convert JPEG back to ImageData for comparison
-    if (item.jpegDataUrl) {
-      try {
-        const restoredImageData = await jpegToImageData(item.jpegDataUrl)
-        setPreviousImageData(restoredImageData)
-      } catch (err) {
-        console.error('Failed to restore image from JPEG:', err)
-      }
+  const handleCompareWithHistory = useCallback(async (item: HistoryItem) => {
+    try {
+      const image = await renderHistoryItem(item)
+      if (image) setPreviousImageData(image)
+    } catch (err) {
+      console.error('Failed to render history version:', err)
     }
-  }, [])
+  }, [renderHistoryItem])
   
   // Compare two history items
-  const handleCompareTwoItems = useCallback(async (item1: {
-    id: string
-    imageData: ImageData | null
-    jpegDataUrl: string | null
-    params: EditParams
-    timestamp: Date
-  }, item2: {
-    id: string
-    imageData: ImageData | null
-    jpegDataUrl: string | null
-    params: EditParams
-    timestamp: Date
-  }) => {
+  const handleCompareTwoItems = useCallback(async (item1: HistoryItem, item2: HistoryItem) => {
+    restoringIdRef.current = item2.id
     try {
-      if (item1.jpegDataUrl && item2.jpegDataUrl) {
-        // Convert both JPEGs to ImageData without triggering processing
-        const [imageData1, imageData2] = await Promise.all([
-          jpegToImageData(item1.jpegDataUrl),
-          jpegToImageData(item2.jpegDataUrl)
-        ])
-        
-        // Set both images for comparison without processing
-        setPreviousImageData(imageData1)
-        setDisplayImageData(imageData2)
-        setCurrentComparisonData(null)
-        
-        // Update params to match item2 without processing
-        setEditParams(item2.params)
-        setLastProcessedParams(item2.params)
-        setHasUnsavedChanges(false)
-      }
+      // One after the other: a second render request would supersede the first
+      const imageData1 = await renderHistoryItem(item1)
+      const imageData2 = await renderHistoryItem(item2)
+      if (!imageData1 || !imageData2 || restoringIdRef.current !== item2.id) return
+      
+      // Set both images for comparison without processing
+      setPreviousImageData(imageData1)
+      setDisplayImageData(imageData2)
+      setDisplayScale(1)
+      setCurrentComparisonData(null)
+      
+      // Update params to match item2 without processing
+      setEditParams(item2.params)
+      setLastProcessedParams(item2.params)
+      setHasUnsavedChanges(false)
     } catch (err) {
       console.error('Failed to compare two history items:', err)
     }
-  }, [])
+  }, [renderHistoryItem])
+  
+  // Full-size file of a history version for export, encoded in the worker
+  // at 16 bits per sample for PNG and TIFF. Builds without the encoders
+  // fall back to an 8-bit canvas encode, which has no TIFF.
+  const exportHistoryItem = useCallback(async (item: HistoryItem, format: ExportFormat): Promise<Blob | null> => {
+    const encoded = await encodeImage(item.params, { format })
+    if (encoded) return new Blob([encoded.data], { type: encoded.mimeType })
+    if (format === 'tiff') return null
+    
+    const image = await renderHistoryItem(item)
+    return image ? imageDataToBlob(image, `image/${format}`) : null
+  }, [encodeImage, renderHistoryItem])
   
   // Keyboard shortcuts
   useEffect(() => {
@@ -265,7 +304,7 @@ export default function EditorPage() {
       }
       
       // Space: Process image
-      if (e.key === ' ' && !isProcessing && hasUnsavedChanges) {
+      if (e.key === ' ' && !isBusy && hasUnsavedChanges) {
         e.preventDefault()
         handleProcess()
       }
@@ -278,7 +317,7 @@ export default function EditorPage() {
     
     window.addEventListener('keydown', handleKeyPress)
     return () => window.removeEventListener('keydown', handleKeyPress)
-  }, [isProcessing, hasUnsavedChanges, handleProcess])
+  }, [isBusy, hasUnsavedChanges, handleProcess])
 
   return (
     <div className="h-full flex" data-testid="editor-container">
@@ -287,7 +326,7 @@ export default function EditorPage() {
         {/* Histogram and Process Button */}
         <div className="h-32 bg-gray-800 border-b border-gray-700">
           <div className="h-24 px-4 py-2">
-            <Histogram imageData={imageData} />
+            <Histogram imageData={imageData} analysis={analysis} />
           </div>
           <div className="px-4 pb-2 flex justify-between">
             <button
@@ -303,17 +342,17 @@ export default function EditorPage() {
             </button>
             <button
               onClick={handleProcess}
-              disabled={isProcessing || isLoading || !photo?.file}
+              disabled={isBusy || !photo?.file}
               className={`px-6 py-2 rounded font-medium transition-colors relative ${
-                isProcessing || isLoading || !photo?.file
+                isBusy || !photo?.file
                   ? 'bg-gray-600 text-gray-400 cursor-not-allowed'
                   : hasUnsavedChanges
                   ? 'bg-orange-600 text-white hover:bg-orange-700 active:bg-orange-800'
                   : 'bg-blue-600 text-white hover:bg-blue-700 active:bg-blue-800'
               }`}
             >
-              {isProcessing ? 'Processing...' : hasUnsavedChanges ? 'Process (unsaved)' : 'Process'}
-              {hasUnsavedChanges && !isProcessing && (
+              {isBusy ? 'Processing...' : hasUnsavedChanges ? 'Process (unsaved)' : 'Process'}
+              {hasUnsavedChanges && !isBusy && (
                 <span className="absolute -top-1 -right-1 w-3 h-3 bg-orange-400 rounded-full animate-pulse" />
               )}
             </button>
@@ -328,6 +367,9 @@ export default function EditorPage() {
             currentComparisonData={currentComparisonData}
             showComparison={historyMode === 'compare' && historySelection.length === 2}
             isProcessing={isProcessing || isLoading}
+            previewScale={isPreview ? previewScale : displayScale}
+            detail={historyMode === 'single' ? detail : null}
+            onViewportChange={setViewport}
           />
           {error && (
             <div className="absolute bottom-4 left-4 bg-red-600 text-white px-4 py-2 rounded">
@@ -407,6 +449,7 @@ export default function EditorPage() {
         isOpen={showExportDialog}
         onClose={() => setShowExportDialog(false)}
         history={imageHistory}
+        renderItem={exportHistoryItem}
         currentImageData={imageData}
         currentParams={editParams}
       />
@@ -4,14 +4,36 @@ import { useState, useRef } from "react"
 import { useRouter } from "next/navigation"
 import { usePhotosStore } from "@/lib/store/photos"
 import { Photo } from "@/lib/types"
+import { getLibRawWorkerPool, readThumbnail, thumbnailHeapEstimate } from "@/lib/libraw/worker-pool"
 
 export default function LibraryPage() {
   const router = useRouter()
   const fileInputRef = useRef<HTMLInputElement>(null)
   const [isDragging, setIsDragging] = useState(false)
-  const { photos, addPhoto, setCurrentPhoto } = usePhotosStore()
+  const { photos, addPhoto, updatePhoto, setCurrentPhoto } = usePhotosStore()
   const photosList = Array.from(photos.values())
 
+  // Fills in thumbnails and metadata as the pool gets to each file. The
+  // pool outlives this page, so opening the editor doesn't stop it.
+  const extractThumbnails = (imported: Array<{ id: string; file: File }>) => {
+    getLibRawWorkerPool().forEach(
+      imported,
+      (client, { file }) => readThumbnail(client, file),
+      ({ id, file }, result, error) => {
+        if (!result) {
+          console.warn(`Failed to read ${file.name}:`, error)
+          return
+        }
+        const { metadata, thumbnail } = result
+        const thumbnailUrl = thumbnail?.format === 'jpeg'
+          ? URL.createObjectURL(new Blob([thumbnail.data], { type: 'image/jpeg' }))
+          : undefined
+        updatePhoto(id, { metadata, thumbnailUrl, updatedAt: new Date() })
+      },
+      ({ file }) => thumbnailHeapEstimate(file)
+    )
+  }
+
   const handleDrop = async (e: React.DragEvent) => {
     e.preventDefault()
     setIsDragging(false)
@@ -24,6 +46,7 @@ export default function LibraryPage() {
     if (rawFiles.length > 0) {
       // Create photo objects and add to store
       const firstPhotoId = `photo-${Date.now()}-0`
+      const imported: Array<{ id: string; file: File }> = []
       
       rawFiles.forEach((file, index) => {
         const photo: Photo = {
@@ -46,7 +69,9 @@ export default function LibraryPage() {
         }
         
         addPhoto(photo, file)
+        imported.push({ id: photo.id, file })
       })
+      extractThumbnails(imported)
       
       // Set current photo and navigate
       setCurrentPhoto(firstPhotoId)
@@ -72,6 +97,7 @@ export default function LibraryPage() {
     if (rawFiles.length > 0) {
       // Create photo objects and add to store
       const firstPhotoId = `photo-${Date.now()}-0`
+      const imported: Array<{ id: string; file: File }> = []
       
       rawFiles.forEach((file, index) => {
         const photo: Photo = {
@@ -94,7 +120,9 @@ export default function LibraryPage() {
         }
         
         addPhoto(photo, file)
+        imported.push({ id: photo.id, file })
       })
+      extractThumbnails(imported)
       
       // Set current photo and navigate
       setCurrentPhoto(firstPhotoId)
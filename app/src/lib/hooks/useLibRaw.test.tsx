@@ -6,8 +6,11 @@ import { createTestEditParams } from '@/test/utils'
 // Mock the LibRaw client
 let mockClient: any
 
+const mockAnalyses = new WeakMap<ImageData, any>()
+
 vi.mock('@/lib/libraw/client', () => ({
   getLibRawClient: () => mockClient,
+  getImageAnalysis: (image: ImageData) => mockAnalyses.get(image) ?? null,
 }))
 
 // Mock URL.createObjectURL
@@ -28,11 +31,33 @@ describe('useLibRaw', () => {
         height: 100,
       }),
       process: vi.fn().mockResolvedValue(new ImageData(100, 100)),
+      processProgressive: vi.fn().mockImplementation(async (_params: any, onPreview: any) => {
+        onPreview(new ImageData(50, 50), 2)
+        return new ImageData(100, 100)
+      }),
+      processRegion: vi.fn().mockImplementation(async (_params: any, region: any) => ({
+        image: new ImageData(region.width, region.height),
+        region,
+      })),
       dispose: vi.fn(),
       getThumbnail: vi.fn().mockResolvedValue({
         format: 'jpeg',
         data: new Uint8Array([0xFF, 0xD8, 0xFF]) // Mock JPEG data
       }),
+      getCachedPreview: vi.fn(() => null),
+      processLinear: vi.fn().mockImplementation(async () => ({
+        data: new Uint16Array(2 * 2 * 4).fill(32768),
+        width: 2,
+        height: 2,
+        format: 'uint16',
+      })),
+      encode: vi.fn().mockResolvedValue({
+        data: new Uint8Array([0x89, 0x50, 0x4E, 0x47]),
+        mimeType: 'image/png',
+        width: 100,
+        height: 100,
+        bits: 16,
+      }),
     }
   })
 
@@ -64,6 +89,22 @@ describe('useLibRaw', () => {
     })
   })
 
+  it('should show the cached render instead of the embedded thumbnail', async () => {
+    const preview = new Blob([new Uint8Array([0xFF, 0xD8, 0xFF])], { type: 'image/jpeg' })
+    mockClient.getCachedPreview.mockReturnValueOnce(preview)
+    
+    const { result } = renderHook(() => useLibRaw())
+    const testFile = new File(['test'], 'test.arw', { type: 'image/x-sony-arw' })
+    
+    await act(async () => {
+      await result.current.loadFile(testFile)
+    })
+    
+    expect(URL.createObjectURL).toHaveBeenCalledWith(preview)
+    expect(mockClient.getThumbnail).not.toHaveBeenCalled()
+    expect(result.current.thumbnail).toBe('blob:mock-url')
+  })
+
   it('should handle loading errors', async () => {
     mockClient.loadFile.mockRejectedValueOnce(new Error('Failed to load'))
     
@@ -101,6 +142,193 @@ describe('useLibRaw', () => {
     })
   })
 
+  it('should show the preview until the full render arrives', async () => {
+    let finish: (image: ImageData | null) => void = () => {}
+    mockClient.processProgressive.mockImplementationOnce((_params: any, onPreview: any) => {
+      onPreview(new ImageData(50, 50), 4)
+      return new Promise(resolve => { finish = resolve })
+    })
+    
+    const { result } = renderHook(() => useLibRaw())
+    const testFile = new File(['test'], 'test.arw', { type: 'image/x-sony-arw' })
+    await act(async () => {
+      await result.current.loadFile(testFile)
+    })
+    
+    let processing!: Promise<void>
+    act(() => {
+      processing = result.current.process(createTestEditParams())
+    })
+    
+    await waitFor(() => {
+      expect(result.current.imageData?.width).toBe(50)
+      expect(result.current.previewScale).toBe(4)
+      expect(result.current.isPreview).toBe(true)
+      expect(result.current.isProcessing).toBe(true)
+    })
+    
+    await act(async () => {
+      finish(new ImageData(100, 100))
+      await processing
+    })
+    
+    expect(result.current.imageData?.width).toBe(100)
+    expect(result.current.isPreview).toBe(false)
+    expect(result.current.isProcessing).toBe(false)
+  })
+
+  it('should let a newer request supersede the previous one', async () => {
+    const finishers: Array<(image: ImageData | null) => void> = []
+    mockClient.processProgressive.mockImplementation(() =>
+      new Promise(resolve => { finishers.push(resolve) })
+    )
+    
+    const { result } = renderHook(() => useLibRaw())
+    const testFile = new File(['test'], 'test.arw', { type: 'image/x-sony-arw' })
+    await act(async () => {
+      await result.current.loadFile(testFile)
+    })
+    
+    let first!: Promise<void>
+    let second!: Promise<void>
+    act(() => {
+      first = result.current.process(createTestEditParams({ exposure: 1 }))
+      second = result.current.process(createTestEditParams({ exposure: 2 }))
+    })
+    
+    expect(mockClient.processProgressive).toHaveBeenCalledTimes(2)
+    
+    // The superseded request resolves with null and leaves state alone
+    await act(async () => {
+      finishers[0](null)
+      await first
+    })
+    expect(result.current.isProcessing).toBe(true)
+    expect(result.current.imageData).toBeNull()
+    
+    await act(async () => {
+      finishers[1](new ImageData(100, 100))
+      await second
+    })
+    expect(result.current.isProcessing).toBe(false)
+    expect(result.current.imageData?.width).toBe(100)
+  })
+
+  it('should render regions into detail until the next full render', async () => {
+    const { result } = renderHook(() => useLibRaw())
+    const testFile = new File(['test'], 'test.arw', { type: 'image/x-sony-arw' })
+    await act(async () => {
+      await result.current.loadFile(testFile)
+    })
+    
+    const region = { x: 10, y: 20, width: 30, height: 40 }
+    await act(async () => {
+      await result.current.renderRegion(createTestEditParams({ exposure: 1 }), region)
+    })
+    expect(result.current.detail?.region).toEqual(region)
+    expect(result.current.isProcessing).toBe(false)
+    
+    await act(async () => {
+      await result.current.process(createTestEditParams({ exposure: 1 }))
+    })
+    expect(result.current.detail).toBeNull()
+  })
+
+  it('should not render a region while a full render runs', async () => {
+    let finish: (image: ImageData | null) => void = () => {}
+    mockClient.processProgressive.mockImplementationOnce(() =>
+      new Promise(resolve => { finish = resolve })
+    )
+    
+    const { result } = renderHook(() => useLibRaw())
+    const testFile = new File(['test'], 'test.arw', { type: 'image/x-sony-arw' })
+    await act(async () => {
+      await result.current.loadFile(testFile)
+    })
+    
+    let processing!: Promise<void>
+    act(() => {
+      processing = result.current.process(createTestEditParams())
+    })
+    await act(async () => {
+      await result.current.renderRegion(createTestEditParams(), { x: 0, y: 0, width: 10, height: 10 })
+    })
+    expect(mockClient.processRegion).not.toHaveBeenCalled()
+    
+    await act(async () => {
+      finish(new ImageData(100, 100))
+      await processing
+    })
+  })
+
+  it('should return renderImage() results without replacing the image', async () => {
+    const { result } = renderHook(() => useLibRaw())
+    const testFile = new File(['test'], 'test.arw', { type: 'image/x-sony-arw' })
+    await act(async () => {
+      await result.current.loadFile(testFile)
+    })
+    
+    let image: ImageData | null = null
+    await act(async () => {
+      image = await result.current.renderImage(createTestEditParams({ exposure: 1 }))
+    })
+    
+    expect(image).toBeInstanceOf(ImageData)
+    expect(mockClient.process).toHaveBeenCalledTimes(1)
+    expect(result.current.imageData).toBeNull()
+    expect(result.current.isProcessing).toBe(false)
+  })
+
+  it('should encode exports with the mapped parameters', async () => {
+    const { result } = renderHook(() => useLibRaw())
+    const testFile = new File(['test'], 'test.arw', { type: 'image/x-sony-arw' })
+    await act(async () => {
+      await result.current.loadFile(testFile)
+    })
+    
+    let encoded: any = null
+    await act(async () => {
+      encoded = await result.current.encodeImage(createTestEditParams({ exposure: 1 }), { format: 'png', bits: 16 })
+    })
+    
+    expect(encoded?.mimeType).toBe('image/png')
+    const [params, options] = mockClient.encode.mock.calls[0]
+    expect(params.look).toMatchObject({ exposure: 1 })
+    expect(params.brightness).toBeUndefined()
+    expect(options).toEqual({ format: 'png', bits: 16 })
+    expect(mockClient.process).not.toHaveBeenCalled()
+  })
+
+  it('should not encode without loaded file', async () => {
+    const { result } = renderHook(() => useLibRaw())
+    
+    let encoded: any = 'unset'
+    await act(async () => {
+      encoded = await result.current.encodeImage(createTestEditParams(), { format: 'jpeg' })
+    })
+    
+    expect(encoded).toBeNull()
+    expect(mockClient.encode).not.toHaveBeenCalled()
+  })
+
+  it('should expose the analysis that came with the image', async () => {
+    const image = new ImageData(100, 100)
+    const analysis = { histogram: new Uint32Array(1024), mean: [1, 2, 3, 4] }
+    mockAnalyses.set(image, analysis)
+    mockClient.processProgressive.mockResolvedValueOnce(image)
+    
+    const { result } = renderHook(() => useLibRaw())
+    const testFile = new File(['test'], 'test.arw', { type: 'image/x-sony-arw' })
+    await act(async () => {
+      await result.current.loadFile(testFile)
+    })
+    await act(async () => {
+      await result.current.process(createTestEditParams())
+    })
+    
+    expect(result.current.analysis).toBe(analysis)
+  })
+
   it('should not process without loaded file', async () => {
     const { result } = renderHook(() => useLibRaw())
     
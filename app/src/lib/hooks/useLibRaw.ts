@@ -1,17 +1,37 @@
 "use client"
 
-import { useState, useCallback, useEffect, useRef } from "react"
-import { getLibRawClient } from "@/lib/libraw/client"
-import { ProcessParams, PhotoMetadata, EditParams } from "@/lib/types"
+import { useState, useCallback, useEffect, useMemo, useRef } from "react"
+import { getLibRawClient, getImageAnalysis } from "@/lib/libraw/client"
+import { editLook } from "@/lib/libraw/look"
+import { ProcessParams, PhotoMetadata, EditParams, ImageRegion, RegionImage, ImageAnalysis, EncodeOptions, EncodedImage } from "@/lib/types"
 
 interface UseLibRawReturn {
   loadFile: (file: File) => Promise<void>
   process: (editParams: EditParams) => Promise<void>
+  // Renders only region (full-size pixels) into detail. Skipped while a
+  // full render runs, which it would otherwise supersede.
+  renderRegion: (editParams: EditParams, region: ImageRegion) => Promise<void>
+  // Full render returned to the caller instead of replacing imageData,
+  // e.g. to bring back an evicted history version. null when superseded.
+  renderImage: (editParams: EditParams) => Promise<ImageData | null>
+  // Full render encoded as a file in the worker, for export. null when the
+  // build cannot encode the format and the caller has to fall back.
+  encodeImage: (editParams: EditParams, options: EncodeOptions) => Promise<EncodedImage | null>
   imageData: ImageData | null
+  // Histograms and statistics computed with imageData, null when the
+  // build has no analysis pass
+  analysis: ImageAnalysis | null
+  // Latest region render; cleared by the next full render
+  detail: RegionImage | null
   metadata: PhotoMetadata | null
   thumbnail: string | null  // Data URL for thumbnail
   isLoading: boolean
   isProcessing: boolean
+  // imageData is a smaller proxy and the full render is still running
+  isPreview: boolean
+  // Full-size pixels per imageData pixel while isPreview, e.g. 2 for a
+  // half-size proxy
+  previewScale: number
   error: string | null
 }
 
@@ -33,45 +53,19 @@ function mapEditToProcessParams(editParams: EditParams): ProcessParams {
   
   return {
     useCameraWB: !customWB, // Use camera WB if no custom WB
-    // Saturation affects output color space
-    outputColor: editParams.saturation > 50 ? 2 : // Adobe RGB for more saturation
-                 editParams.saturation < -50 ? 0 : // Raw color for less
-                 1, // sRGB for normal
-    brightness: 1.0 + (editParams.exposure / 5), // Map -5 to +5 -> 0 to 2
+    outputColor: 1, // sRGB
     quality: 3, // AHD interpolation
     halfSize: false,
     
-    // Highlights/shadows mapped to highlight recovery mode
+    // Strong highlight pulls also reconstruct clipped highlights, which
+    // only a render can do; the look compresses the rest
     highlight: editParams.highlights < -50 ? 2 : // Blend mode for strong highlight recovery
                editParams.highlights < -20 ? 1 : // Unclip for moderate
                0, // Clip for normal
     
-    // Contrast mapped to gamma curve
-    gamma: editParams.contrast !== 0 ? [
-      2.2 + (editParams.contrast / 200), // Gamma: 1.7 to 2.7
-      4.5 - (editParams.contrast / 50)   // Toe: 3.5 to 6.5
-    ] : undefined,
-    
-    // Shadows/blacks affect exposure and black level
-    exposure: (editParams.shadows !== 0 || editParams.blacks !== 0) ? {
-      shift: editParams.shadows / 100, // -1 to 1
-      preserve: editParams.highlights < 0 ? 1.0 : 0.0 // Preserve highlights if pulling them down
-    } : undefined,
-    
-    // User black level from blacks adjustment
-    userBlack: editParams.blacks !== 0 ? 
-      Math.max(0, 128 + editParams.blacks * 1.28) : // Map -100 to +100 -> 0 to 256
-      undefined,
-    
     // Custom white balance from temperature/tint
     customWB,
     
-    // Auto brightness for whites adjustment
-    autoBright: editParams.whites !== 0 ? {
-      enabled: true,
-      threshold: 0.01 + (editParams.whites / 10000) // 0.001 to 0.02
-    } : undefined,
-    
     // Advanced parameters
     cropArea: editParams.cropEnabled && editParams.cropArea ? editParams.cropArea : undefined,
     userFlip: editParams.userFlip,
@@ -82,18 +76,20 @@ function mapEditToProcessParams(editParams: EditParams): ProcessParams {
     dcbEnhance: editParams.dcbEnhance,
     outputBPS: editParams.outputBPS,
     
-    // Color adjustments
-    saturation: editParams.saturation,
-    vibrance: editParams.vibrance,
+    // Tone and color, applied to the rendered image without a re-render
+    look: editLook(editParams),
   }
 }
 
 export function useLibRaw(): UseLibRawReturn {
   const [imageData, setImageData] = useState<ImageData | null>(null)
+  const [detail, setDetail] = useState<RegionImage | null>(null)
   const [metadata, setMetadata] = useState<PhotoMetadata | null>(null)
   const [thumbnail, setThumbnail] = useState<string | null>(null)
   const [isLoading, setIsLoading] = useState(false)
   const [isProcessing, setIsProcessing] = useState(false)
+  const [isPreview, setIsPreview] = useState(false)
+  const [previewScale, setPreviewScale] = useState(1)
   const [error, setError] = useState<string | null>(null)
   
   const clientRef = useRef(getLibRawClient())
@@ -111,21 +107,28 @@ export function useLibRaw(): UseLibRawReturn {
       loadingRef.current = true
       setIsLoading(true)
       setError(null)
+      setDetail(null)
       
       const meta = await clientRef.current.loadFile(file)
       setMetadata(meta)
       
-      // Try to extract thumbnail
-      try {
-        const thumbnailData = await clientRef.current.getThumbnail()
-        if (thumbnailData && thumbnailData.format === 'jpeg') {
-          // Convert thumbnail to data URL
-          const blob = new Blob([thumbnailData.data], { type: 'image/jpeg' })
-          const dataUrl = URL.createObjectURL(blob)
-          setThumbnail(dataUrl)
+      // Show the last render of a cached file, otherwise try to extract
+      // the thumbnail
+      const cachedPreview = clientRef.current.getCachedPreview()
+      if (cachedPreview) {
+        setThumbnail(URL.createObjectURL(cachedPreview))
+      } else {
+        try {
+          const thumbnailData = await clientRef.current.getThumbnail()
+          if (thumbnailData && thumbnailData.format === 'jpeg') {
+            // Convert thumbnail to data URL
+            const blob = new Blob([thumbnailData.data], { type: 'image/jpeg' })
+            const dataUrl = URL.createObjectURL(blob)
+            setThumbnail(dataUrl)
+          }
+        } catch (thumbError) {
+          console.warn('Failed to extract thumbnail:', thumbError)
         }
-      } catch (thumbError) {
-        console.warn('Failed to extract thumbnail:', thumbError)
       }
       
       fileLoadedRef.current = true
@@ -142,7 +145,10 @@ export function useLibRaw(): UseLibRawReturn {
     }
   }, [])
 
-  const processingRef = useRef(false)
+  // Each call supersedes the previous one; only the latest may update state
+  const requestRef = useRef(0)
+  const regionRequestRef = useRef(0)
+  const fullRenderRef = useRef(false)
   
   const process = useCallback(async (editParams: EditParams) => {
     if (!fileLoadedRef.current) {
@@ -150,27 +156,70 @@ export function useLibRaw(): UseLibRawReturn {
       return
     }
     
-    // Prevent multiple simultaneous processing
-    if (processingRef.current) {
-      return
-    }
+    const request = ++requestRef.current
+    const isCurrent = () => requestRef.current === request
     
     try {
-      processingRef.current = true
+      fullRenderRef.current = true
       setIsProcessing(true)
       setError(null)
       
       const processParams = mapEditToProcessParams(editParams)
-      const data = await clientRef.current.process(processParams)
-      setImageData(data)
+      const data = await clientRef.current.processProgressive(processParams, (preview, scale) => {
+        if (isCurrent()) {
+          setImageData(preview)
+          setPreviewScale(scale)
+          setIsPreview(true)
+        }
+      })
+      
+      // null: a newer request took over before the full render started
+      if (data && isCurrent()) {
+        setImageData(data)
+        setDetail(null)
+        setIsPreview(false)
+      }
     } catch (err) {
-      setError(err instanceof Error ? err.message : "Failed to process image")
+      if (isCurrent()) {
+        setError(err instanceof Error ? err.message : "Failed to process image")
+        setIsPreview(false)
+      }
       console.error("Failed to process image:", err)
     } finally {
-      setIsProcessing(false)
-      processingRef.current = false
+      if (isCurrent()) {
+        fullRenderRef.current = false
+        setIsProcessing(false)
+      }
     }
   }, [])
+  
+  const renderRegion = useCallback(async (editParams: EditParams, region: ImageRegion) => {
+    if (!fileLoadedRef.current || fullRenderRef.current) return
+    
+    const request = ++regionRequestRef.current
+    try {
+      const result = await clientRef.current.processRegion(mapEditToProcessParams(editParams), region)
+      // null: superseded by a newer region or a full render
+      if (result && regionRequestRef.current === request && !fullRenderRef.current) {
+        setDetail(result)
+      }
+    } catch (err) {
+      // The full frame is still there; the detail just stays as it was
+      console.warn("Failed to render region:", err)
+    }
+  }, [])
+
+  const renderImage = useCallback(async (editParams: EditParams) => {
+    if (!fileLoadedRef.current) return null
+    return clientRef.current.process(mapEditToProcessParams(editParams))
+  }, [])
+
+  const encodeImage = useCallback(async (editParams: EditParams, options: EncodeOptions) => {
+    if (!fileLoadedRef.current) return null
+    return clientRef.current.encode(mapEditToProcessParams(editParams), options)
+  }, [])
+
+  const analysis = useMemo(() => (imageData ? getImageAnalysis(imageData) : null), [imageData])
 
   // Cleanup on unmount
   useEffect(() => {
@@ -182,11 +231,18 @@ export function useLibRaw(): UseLibRawReturn {
   return {
     loadFile,
     process,
+    renderRegion,
+    renderImage,
+    encodeImage,
     imageData,
+    analysis,
+    detail,
     metadata,
     thumbnail,
     isLoading,
     isProcessing,
+    isPreview,
+    previewScale,
     error,
   }
 }
\ No newline at end of file
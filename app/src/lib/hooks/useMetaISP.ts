@@ -4,13 +4,15 @@
  */
 
 import { useState, useCallback, useRef, useEffect } from 'react';
-import { MetaISPProcessor, ProcessingProgress } from '@/lib/metaisp/metaisp-processor';
-import { LibRawMetaISPBridge } from '@/lib/libraw/metaisp-integration';
+import { MetaISPOutputConverter, MetaISPProcessor, ProcessingProgress } from '@/lib/metaisp/metaisp-processor';
+import { LibRawMetaISPBridge, MetaISPHeap } from '@/lib/libraw/metaisp-integration';
 
 export interface MetaISPOptions {
   targetDevice?: 'iphone' | 'samsung' | 'pixel' | 'auto';
   modelPath?: string;
   executionProvider?: 'webgpu' | 'wasm';
+  // e.g. LibRawClient.convertTensor, to convert the output in the worker
+  convertOutput?: MetaISPOutputConverter;
   onProgress?: (progress: ProcessingProgress) => void;
 }
 
@@ -45,7 +47,8 @@ export function useMetaISP(options: MetaISPOptions = {}) {
       
       const processor = new MetaISPProcessor({
         modelPath: options.modelPath || '/models/metaisp.onnx',
-        executionProvider: options.executionProvider || 'wasm'
+        executionProvider: options.executionProvider || 'wasm',
+        convertOutput: options.convertOutput
       });
       
       await processor.initialize((progress) => {
@@ -73,12 +76,13 @@ export function useMetaISP(options: MetaISPOptions = {}) {
       }));
       console.error('MetaISP initialization failed:', error);
     }
-  }, [state.isInitialized, options.modelPath, options.executionProvider]);
+  }, [state.isInitialized, options.modelPath, options.executionProvider, options.convertOutput]);
   
   // Process RAW image
   const processRAW = useCallback(async (
     librawInstance: any,
-    targetDevice?: 'iphone' | 'samsung' | 'pixel' | 'auto'
+    targetDevice?: 'iphone' | 'samsung' | 'pixel' | 'auto',
+    heap?: MetaISPHeap
   ): Promise<ImageData | null> => {
     if (!processorRef.current) {
       await initialize();
@@ -96,13 +100,13 @@ export function useMetaISP(options: MetaISPOptions = {}) {
     
     try {
       // Create bridge
-      const bridge = new LibRawMetaISPBridge(librawInstance);
+      const bridge = new LibRawMetaISPBridge(librawInstance, heap);
       bridgeRef.current = bridge;
       
       // Check compatibility
       const isCompatible = await bridge.isMetaISPCompatible();
       if (!isCompatible) {
-        throw new Error('RAW file is not compatible with MetaISP (requires RGGB pattern)');
+        throw new Error('RAW file is not compatible with MetaISP (requires a Bayer sensor)');
       }
       
       // Prepare data
@@ -111,28 +115,70 @@ export function useMetaISP(options: MetaISPOptions = {}) {
         progress: { stage: 'preparing', progress: 0, message: 'Preparing RAW data...' }
       }));
       
-      const data = await bridge.prepareForMetaISP();
-      if (!data) {
-        throw new Error('Failed to prepare data for MetaISP');
-      }
-      
-      // Create inputs
       const device = targetDevice || options.targetDevice || 'auto';
-      const inputs = bridge.createMetaISPInputs(data, device === 'auto' ? undefined : device);
+      const target = device === 'auto' ? undefined : device;
+      const processor = processorRef.current;
+      let result: ImageData;
       
-      // Add dimensions
-      const inputsWithDimensions = {
-        ...inputs,
-        dimensions: {
-          rawWidth: data.bayerChannels.width,
-          rawHeight: data.bayerChannels.height,
-          fullWidth: data.bilinearRGB.width,
-          fullHeight: data.bilinearRGB.height
+      if (bridge.canPackNatively()) {
+        // Packed on the WASM heap in one pass; large frames tile by tile
+        const layout = bridge.getLayout()!;
+        const width = layout.width & ~1;
+        const height = layout.height & ~1;
+        const dimensions = { rawWidth: width >> 1, rawHeight: height >> 1, fullWidth: width, fullHeight: height };
+        const metadata = await bridge.getMetaISPMetadata();
+        
+        if (processor.needsTiling(width, height)) {
+          const scalars = bridge.createMetaISPInputs({
+            bayerChannels: { width: dimensions.rawWidth, height: dimensions.rawHeight, data: new Float32Array(0) },
+            bilinearRGB: { width, height, data: new Float32Array(0) },
+            metadata
+          }, target);
+          const source = bridge.createTileSource();
+          try {
+            result = await processor.processTiled({ ...scalars, dimensions }, undefined, undefined, source);
+          } finally {
+            source.dispose();
+          }
+        } else {
+          const packed = bridge.packInputs();
+          if (!packed) {
+            throw new Error('Failed to prepare data for MetaISP');
+          }
+          try {
+            const inputs = bridge.createMetaISPInputs({
+              bayerChannels: { width: dimensions.rawWidth, height: dimensions.rawHeight, data: packed.raw },
+              bilinearRGB: { width, height, data: packed.raw_full },
+              metadata
+            }, target);
+            result = await processor.process({ ...inputs, dimensions });
+          } finally {
+            packed.dispose();
+          }
         }
-      };
-      
-      // Process
-      const result = await processorRef.current.process(inputsWithDimensions);
+      } else {
+        const data = await bridge.prepareForMetaISP();
+        if (!data) {
+          throw new Error('Failed to prepare data for MetaISP');
+        }
+        
+        // Create inputs
+        const inputs = bridge.createMetaISPInputs(data, target);
+        
+        // Add dimensions
+        const inputsWithDimensions = {
+          ...inputs,
+          dimensions: {
+            rawWidth: data.bayerChannels.width,
+            rawHeight: data.bayerChannels.height,
+            fullWidth: data.bilinearRGB.width,
+            fullHeight: data.bilinearRGB.height
+          }
+        };
+        
+        // Process
+        result = await processor.process(inputsWithDimensions);
+      }
       
       setState(prev => ({
         ...prev,
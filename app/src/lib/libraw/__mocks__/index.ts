@@ -7,6 +7,10 @@ export class LibRawWASM implements LibRawProcessor {
   static async create(): Promise<LibRawWASM> {
     return new LibRawWASM()
   }
+
+  static fromModule(): LibRawWASM {
+    return new LibRawWASM()
+  }
   
   async loadFile(buffer: ArrayBuffer): Promise<void> {
     this.loaded = true
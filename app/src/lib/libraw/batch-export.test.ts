@@ -0,0 +1,128 @@
+import { describe, it, expect, vi, beforeEach } from 'vitest'
+import { LibRawWorkerPool } from './worker-pool'
+import { exportBatch, presetParams, PROCESS_PRESETS } from './batch-export'
+
+const { FakeClient } = vi.hoisted(() => {
+  // Encodes the name of the loaded file; a name with "broken" fails
+  class FakeClient {
+    static encoded: string[] = []
+    static encoder = true
+    file: File | null = null
+
+    constructor(public options: any) {}
+
+    async getHeapSize() {
+      return 0
+    }
+
+    async loadFile(file: File) {
+      this.file = file
+    }
+
+    async encode(params: any, options: any) {
+      if (!FakeClient.encoder) return null
+      if (this.file!.name.includes('broken')) throw new Error('Failed to load RAW file')
+      FakeClient.encoded.push(this.file!.name)
+      return { data: new TextEncoder().encode(this.file!.name), mimeType: 'image/jpeg', width: 1, height: 1, bits: 8, params, options }
+    }
+
+    async dispose() {}
+  }
+  return { FakeClient }
+})
+
+vi.mock('./client', () => ({ LibRawClient: FakeClient }))
+
+vi.mock('./wasm-loader-helper', () => ({
+  isSimdSupported: () => true,
+  compileLibRawWasm: vi.fn(async () => ({ compiled: true })),
+}))
+
+function makeFiles(...names: string[]) {
+  return names.map(name => new File(['raw'], name))
+}
+
+describe('exportBatch', () => {
+  beforeEach(() => {
+    FakeClient.encoded = []
+    FakeClient.encoder = true
+  })
+
+  it('should export every file with the shared params and collect failures', async () => {
+    const pool = new LibRawWorkerPool({ size: 2, heapBudget: 200 * 1024 * 1024 })
+    const written: Array<[string, any]> = []
+    const progress: number[] = []
+
+    const result = await exportBatch(
+      pool,
+      makeFiles('a.ARW', 'broken.ARW', 'c.ARW', 'd.ARW'),
+      presetParams('lowLight'),
+      { format: 'jpeg', quality: 85 },
+      async (file, encoded) => { written.push([file.name, encoded]) },
+      { onProgress: done => progress.push(done) }
+    )
+
+    expect(result.succeeded).toBe(3)
+    expect(result.failed.map(f => [f.file.name, f.error.message])).toEqual([['broken.ARW', 'Failed to load RAW file']])
+    expect(written.map(([name]) => name).sort()).toEqual(['a.ARW', 'c.ARW', 'd.ARW'])
+    const [, encoded] = written[0]
+    expect(encoded.params).toMatchObject({ ...PROCESS_PRESETS.lowLight, memoryBudget: 100 * 1024 * 1024 })
+    expect(encoded.options).toEqual({ format: 'jpeg', quality: 85 })
+    expect(progress).toEqual([1, 2, 3, 4])
+  })
+
+  it('should hold new renders while writes are pending', async () => {
+    const pool = new LibRawWorkerPool({ size: 2 })
+    let release!: () => void
+    const gate = new Promise<void>(resolve => { release = resolve })
+
+    const batch = exportBatch(
+      pool,
+      makeFiles('a.ARW', 'b.ARW', 'c.ARW', 'd.ARW'),
+      {},
+      { format: 'png' },
+      () => gate,
+      { maxPendingWrites: 1 }
+    )
+
+    // Two renders plus one output waiting to be written
+    await vi.waitFor(() => expect(FakeClient.encoded).toHaveLength(3))
+    await new Promise(resolve => setTimeout(resolve, 10))
+    expect(FakeClient.encoded).toHaveLength(3)
+
+    release()
+    const result = await batch
+    expect(result.succeeded).toBe(4)
+  })
+
+  it('should fail files the build cannot encode', async () => {
+    FakeClient.encoder = false
+    const pool = new LibRawWorkerPool({ size: 1 })
+
+    const result = await exportBatch(pool, makeFiles('a.ARW'), {}, { format: 'tiff' }, async () => {})
+
+    expect(result.succeeded).toBe(0)
+    expect(result.failed[0].error.message).toBe('This LibRaw build cannot encode TIFF')
+  })
+
+  it('should stop starting files once aborted', async () => {
+    const pool = new LibRawWorkerPool({ size: 1 })
+    const controller = new AbortController()
+
+    const result = await exportBatch(
+      pool,
+      makeFiles('a.ARW', 'b.ARW', 'c.ARW'),
+      {},
+      { format: 'jpeg' },
+      async () => { controller.abort() },
+      { signal: controller.signal, maxPendingWrites: 1 }
+    )
+
+    expect(result.succeeded).toBe(2)
+    expect(FakeClient.encoded).toEqual(['a.ARW', 'b.ARW'])
+  })
+
+  it('should let overrides take precedence over a preset', () => {
+    expect(presetParams('portrait', { quality: 3 })).toEqual({ ...PROCESS_PRESETS.portrait, useCameraWB: true, quality: 3 })
+  })
+})
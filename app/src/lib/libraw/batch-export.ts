@@ -0,0 +1,106 @@
+"use client"
+
+import { EncodeOptions, EncodedImage, ProcessParams } from "@/lib/types"
+import { LibRawWorkerPool } from "./worker-pool"
+
+// Look presets for batch exports, from the plan in LIBRAW_OPTIMIZATION_PLAN.md.
+// Sharpening is not a LibRaw parameter and is left out; the DCB settings
+// of portrait need the DCB demosaic (quality 4) to have any effect.
+export type ProcessPreset = "portrait" | "landscape" | "lowLight"
+
+export const PROCESS_PRESETS: Record<ProcessPreset, ProcessParams> = {
+  portrait: {
+    quality: 4,
+    highlight: 2,
+    dcbIterations: 3,
+    dcbEnhance: true,
+    look: { vibrance: 10 },
+  },
+  landscape: {
+    quality: 11, // DHT
+    highlight: 5,
+    look: { saturation: 20 },
+  },
+  lowLight: {
+    quality: 3, // AHD
+    noiseThreshold: 500,
+    medianPasses: 3,
+    brightness: 1.5,
+  },
+}
+
+export function presetParams(preset: ProcessPreset, overrides: ProcessParams = {}): ProcessParams {
+  return { useCameraWB: true, ...PROCESS_PRESETS[preset], ...overrides }
+}
+
+export interface BatchExportOptions {
+  // Files between the start of their render and the end of their write
+  // are capped at the pool size plus this, so a slow write() holds back new
+  // renders instead of letting outputs pile up. Defaults to the pool size.
+  maxPendingWrites?: number
+  // Files finished so far, failed ones included
+  onProgress?: (done: number, total: number) => void
+  // Stops starting files; the ones in flight still finish
+  signal?: AbortSignal
+}
+
+export interface BatchExportResult {
+  succeeded: number
+  failed: Array<{ file: File; error: Error }>
+}
+
+// Exports files with one shared params set, as a pipeline: every pool
+// worker streams in, decodes, renders and encodes its own file while
+// write() stores earlier outputs, and the next files are already queued
+// for the workers that finish first.
+export async function exportBatch(
+  pool: LibRawWorkerPool,
+  files: Iterable<File>,
+  params: ProcessParams,
+  encodeOptions: EncodeOptions,
+  write: (file: File, encoded: EncodedImage) => Promise<void>,
+  options: BatchExportOptions = {}
+): Promise<BatchExportResult> {
+  const queue = Array.from(files)
+  const total = queue.length
+  const maxInFlight = pool.size + Math.max(0, options.maxPendingWrites ?? pool.size)
+  const result: BatchExportResult = { succeeded: 0, failed: [] }
+  let done = 0
+  let inFlight = 0
+  const waiters: Array<() => void> = []
+
+  const finish = (file: File, error?: Error) => {
+    done++
+    inFlight--
+    if (error) result.failed.push({ file, error })
+    else result.succeeded++
+    options.onProgress?.(done, total)
+    waiters.shift()?.()
+  }
+
+  const jobs: Promise<void>[] = []
+  for (const file of queue) {
+    while (inFlight >= maxInFlight && !options.signal?.aborted) {
+      await new Promise<void>(resolve => waiters.push(resolve))
+    }
+    if (options.signal?.aborted) break
+
+    inFlight++
+    jobs.push(
+      pool.exportFile(file, params, encodeOptions)
+        .then(encoded => {
+          if (!encoded) {
+            throw new Error(`This LibRaw build cannot encode ${encodeOptions.format.toUpperCase()}`)
+          }
+          return write(file, encoded)
+        })
+        .then(
+          () => finish(file),
+          error => finish(file, error instanceof Error ? error : new Error(String(error)))
+        )
+    )
+  }
+
+  await Promise.all(jobs)
+  return result
+}
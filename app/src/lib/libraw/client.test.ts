@@ -0,0 +1,192 @@
+import { describe, it, expect, vi, beforeEach, afterEach } from 'vitest'
+import { LibRawClient, getImageAnalysis } from './client'
+import { FrameRing } from './frame-ring'
+
+// Records posted messages and lets the test answer them
+class FakeWorker {
+  static current: FakeWorker | null = null
+  messages: any[] = []
+  transfers: Transferable[][] = []
+  private listener: ((event: MessageEvent) => void) | null = null
+
+  constructor() {
+    FakeWorker.current = this
+  }
+
+  addEventListener(_type: string, listener: (event: MessageEvent) => void) {
+    this.listener = listener
+  }
+
+  postMessage(message: any, transfer: Transferable[] = []) {
+    this.messages.push(message)
+    this.transfers.push(transfer)
+  }
+
+  terminate() {}
+
+  respond(data: any) {
+    this.listener?.({ data } as MessageEvent)
+  }
+
+  processMessages() {
+    return this.messages.filter(m => m.type === 'process')
+  }
+}
+
+const rendered = (id: string) => ({
+  type: 'processed',
+  id,
+  data: { data: new ArrayBuffer(4), width: 1, height: 1 },
+})
+
+describe('LibRawClient render coalescing', () => {
+  let client: LibRawClient
+
+  beforeEach(() => {
+    FakeWorker.current = null
+    vi.stubGlobal('Worker', FakeWorker)
+    client = new LibRawClient()
+  })
+
+  afterEach(() => {
+    vi.unstubAllGlobals()
+  })
+
+  it('should keep only the latest waiting request', async () => {
+    const first = client.process({ quality: 3 })
+    await vi.waitFor(() => expect(FakeWorker.current?.processMessages()).toHaveLength(1))
+    const worker = FakeWorker.current!
+
+    const second = client.process({ quality: 1 })
+    const third = client.process({ quality: 2 })
+
+    // The waiting request is dropped, the running one is told to stop
+    await expect(second).resolves.toBeNull()
+    expect(worker.messages).toContainEqual({ type: 'cancel', id: '', data: { seq: 3 } })
+
+    worker.respond({ type: 'cancelled', id: worker.processMessages()[0].id, data: { partial: false } })
+    await expect(first).resolves.toBeNull()
+
+    await vi.waitFor(() => expect(worker.processMessages()).toHaveLength(2))
+    const latest = worker.processMessages()[1]
+    expect(latest.data.params).toEqual({ quality: 2 })
+    expect(latest.data.seq).toBe(3)
+
+    worker.respond(rendered(latest.id))
+    const image = await third
+    expect(image?.width).toBe(1)
+  })
+
+  it('should keep the analysis that came with the image', async () => {
+    const result = client.process({ quality: 3 })
+    await vi.waitFor(() => expect(FakeWorker.current?.processMessages()).toHaveLength(1))
+    const worker = FakeWorker.current!
+    const { id } = worker.processMessages()[0]
+
+    const analysis = { histogram: new Uint32Array(1024), mean: [1, 2, 3, 4] }
+    worker.respond({ type: 'processed', id, data: { data: new ArrayBuffer(4), width: 1, height: 1, analysis } })
+    const image = await result
+    expect(getImageAnalysis(image!)).toBe(analysis)
+    expect(getImageAnalysis(new ImageData(1, 1))).toBeNull()
+  })
+
+  it('should deliver previews without settling the request', async () => {
+    const onPreview = vi.fn()
+    const result = client.processProgressive({ quality: 3 }, onPreview)
+    await vi.waitFor(() => expect(FakeWorker.current?.processMessages()).toHaveLength(1))
+    const worker = FakeWorker.current!
+    const { id, data } = worker.processMessages()[0]
+    expect(data.progressive).toBe(true)
+
+    worker.respond({ type: 'preview', id, data: { data: new ArrayBuffer(4), width: 1, height: 1, scale: 4 } })
+    expect(onPreview).toHaveBeenCalledTimes(1)
+    expect(onPreview.mock.calls[0][1]).toBe(4)
+
+    worker.respond(rendered(id))
+    await expect(result).resolves.not.toBeNull()
+  })
+
+  it('should copy ring frames out and hand their slot back', async () => {
+    vi.stubGlobal('crossOriginIsolated', true)
+    const ring = FrameRing.create(4)!
+    const previews: ImageData[] = []
+    const result = client.processProgressive({ quality: 3 }, image => previews.push(image))
+    await vi.waitFor(() => expect(FakeWorker.current?.processMessages()).toHaveLength(1))
+    const worker = FakeWorker.current!
+    const { id } = worker.processMessages()[0]
+
+    const post = (value: number, first: boolean) => {
+      const slot = ring.acquire()
+      ring.view(slot, 4).fill(value)
+      ring.publish(slot)
+      const frame = { slot, byteLength: 4, ring: first ? ring.buffer : undefined }
+      worker.respond({ type: 'preview', id, data: { frame, width: 1, height: 1 } })
+    }
+    post(7, true)
+    post(9, false)
+
+    expect(previews.map(image => image.data[0])).toEqual([7, 9])
+    expect(previews[0]).not.toBe(previews[1])
+    // Every slot is free again
+    expect(new Set([ring.acquire(), ring.acquire(), ring.acquire()]).size).toBe(3)
+
+    worker.respond(rendered(id))
+    await expect(result).resolves.not.toBeNull()
+  })
+
+  it('should send region renders through the same queue', async () => {
+    const full = client.process({ quality: 3 })
+    await vi.waitFor(() => expect(FakeWorker.current?.processMessages()).toHaveLength(1))
+    const worker = FakeWorker.current!
+
+    const region = { x: 100, y: 50, width: 20, height: 10 }
+    const tile = client.processRegion({ quality: 3 }, region)
+    expect(worker.messages).toContainEqual({ type: 'cancel', id: '', data: { seq: 2 } })
+
+    worker.respond({ type: 'cancelled', id: worker.processMessages()[0].id, data: { partial: false } })
+    await expect(full).resolves.toBeNull()
+
+    await vi.waitFor(() => expect(worker.messages.filter(m => m.type === 'process-region')).toHaveLength(1))
+    const message = worker.messages.find(m => m.type === 'process-region')
+    expect(message.data).toMatchObject({ params: { quality: 3 }, region, scale: 1, seq: 2 })
+
+    worker.respond({ type: 'region', id: message.id, data: { data: new ArrayBuffer(4), width: 1, height: 1, region } })
+    const result = await tile
+    expect(result?.image.width).toBe(1)
+    expect(result?.region).toEqual(region)
+  })
+
+  it('should transfer tensors that own their buffer to the worker', async () => {
+    const tensor = new Float32Array(3 * 4)
+    const result = client.convertTensor(tensor, 2, 2, { width: 4, height: 4, srgb: true })
+    await vi.waitFor(() => expect(FakeWorker.current?.messages).toHaveLength(1))
+    const worker = FakeWorker.current!
+    const [message] = worker.messages
+    expect(message.type).toBe('convert-tensor')
+    expect(message.data).toMatchObject({ srcWidth: 2, srcHeight: 2, options: { width: 4, height: 4, srgb: true } })
+    expect(worker.transfers[0]).toEqual([tensor.buffer])
+
+    worker.respond({ type: 'converted', id: message.id, data: { data: new ArrayBuffer(64), width: 4, height: 4 } })
+    const image = await result
+    expect(image.width).toBe(4)
+
+    // A view into a larger buffer is copied instead
+    client.convertTensor(new Float32Array(new ArrayBuffer(64), 4, 3), 1, 1)
+    await vi.waitFor(() => expect(worker.messages).toHaveLength(2))
+    expect(worker.transfers[1]).toEqual([])
+  })
+
+  it('should read thumbnails without loading the file for editing', async () => {
+    const file = new File(['raw'], 'a.arw')
+    const result = client.extractThumbnail(file)
+    await vi.waitFor(() => expect(FakeWorker.current?.messages).toHaveLength(1))
+    const worker = FakeWorker.current!
+    const [message] = worker.messages
+    expect(message.type).toBe('get-thumbnail-only')
+    expect(message.data.file).toBe(file)
+
+    const extracted = { metadata: { camera: 'Test' }, thumbnail: null }
+    worker.respond({ type: 'thumbnail', id: message.id, data: extracted })
+    await expect(result).resolves.toEqual(extracted)
+  })
+})
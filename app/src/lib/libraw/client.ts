@@ -5,18 +5,58 @@ import {
   ProcessedImage, 
   PhotoMetadata,
   ThumbnailData,
+  ExtractedThumbnail,
+  ImageRegion,
+  RegionImage,
+  EncodeOptions,
+  EncodedImage,
+  ImageAnalysis,
+  TensorConversionOptions,
+  MemoryStats,
+  LinearFormat,
+  LinearImage,
   WorkerMessage,
   WorkerResponse 
 } from "@/lib/types"
+import type { ProcessorOptions } from "./processor-factory"
+import { FrameRing, RingFrame } from "./frame-ring"
+
+// Gets each preview and the full-size pixels per preview pixel
+type PreviewCallback = (image: ImageData, scale: number) => void
+
+interface RenderJob {
+  seq: number
+  type: "process" | "process-region"
+  data: Record<string, unknown>
+  onPreview?: PreviewCallback
+  // Raw worker result, null when superseded
+  resolve: (result: any) => void
+  reject: (error: Error) => void
+}
 
 export class LibRawClient {
   private worker: Worker | null = null
   private messageId = 0
-  private pending = new Map<string, { resolve: Function; reject: Function }>()
+  private pending = new Map<string, { resolve: Function; reject: Function; onPreview?: PreviewCallback }>()
   private initPromise: Promise<void> | null = null
   private initialized = false
+  
+  // Renders (full frames and regions alike) are coalesced: at most one
+  // runs in the worker and one waits. A newer request replaces the waiting
+  // one and cancels the running one.
+  private renderSeq = 0
+  private renderInFlight = false
+  private queuedRender: RenderJob | null = null
+  private cancelSignal: Int32Array | null = createCancelSignal()
+  // JPEG of the last render when the loaded file came from the unpacked cache
+  private cachedPreview: Blob | null = null
+  // The worker's frame ring, from its first ring frame
+  private frameRing: FrameRing | null = null
+  private frameImages = new FrameImagePool()
 
-  constructor() {
+  // moduleOptions go to the worker's 'init' message (build variant,
+  // precompiled wasm, backend); without them the worker picks its own
+  constructor(private readonly moduleOptions: ProcessorOptions | null = null) {
     // Don't initialize in constructor, do it lazily
   }
 
@@ -29,12 +69,18 @@ export class LibRawClient {
         // Set up message handler
         this.worker.addEventListener("message", this.handleMessage.bind(this))
         
-        // Wait a bit for worker to be ready
-        await new Promise(resolve => setTimeout(resolve, 100))
+        if (this.moduleOptions) {
+          // Messages are handled in order, so this also means it is ready
+          await this.post("init", this.moduleOptions)
+        } else {
+          // Wait a bit for worker to be ready
+          await new Promise(resolve => setTimeout(resolve, 100))
+        }
         
         console.log("LibRaw worker initialized")
       } catch (error) {
         console.error("Failed to initialize LibRaw worker:", error)
+        this.worker?.terminate()
         this.worker = null
         throw error
       }
@@ -43,19 +89,44 @@ export class LibRawClient {
 
   private handleMessage(event: MessageEvent<WorkerResponse>) {
     const { id, type, data, error } = event.data
+    // Copied out at once, so that the slot goes back to the worker even
+    // when nobody waits for the frame any more
+    if (data?.frame) {
+      data.image = this.readFrame(type, data)
+    }
+    
     const pending = this.pending.get(id)
     
     if (!pending) return
     
+    // Intermediate result, the request stays pending
+    if (type === "preview") {
+      pending.onPreview?.(toImageData(data), data.scale ?? 1)
+      return
+    }
+    
     this.pending.delete(id)
     
     if (type === "error") {
       pending.reject(new Error(error || "Unknown error"))
+    } else if (type === "cancelled") {
+      pending.resolve(null)
     } else {
       pending.resolve(data)
     }
   }
 
+  // ImageData of a frame the worker rendered into its ring
+  private readFrame(kind: string, result: { frame: RingFrame; width: number; height: number }): ImageData {
+    const { slot, byteLength, ring } = result.frame
+    if (ring) this.frameRing = FrameRing.from(ring)
+    
+    const image = this.frameImages.take(kind, result.width, result.height)
+    image.data.set(this.frameRing!.view(slot, byteLength))
+    this.frameRing!.release(slot)
+    return image
+  }
+
   private async ensureInitialized(): Promise<void> {
     if (!this.initialized && !this.initPromise) {
       this.initPromise = this.initialize()
@@ -66,10 +137,23 @@ export class LibRawClient {
     }
   }
 
-  private async sendMessage(type: WorkerMessage["type"], data?: any): Promise<any> {
+  private async sendMessage(
+    type: WorkerMessage["type"],
+    data?: any,
+    onPreview?: PreviewCallback,
+    transfer: Transferable[] = []
+  ): Promise<any> {
     // Ensure worker is initialized
     await this.ensureInitialized()
-    
+    return this.post(type, data, onPreview, transfer)
+  }
+
+  private post(
+    type: WorkerMessage["type"],
+    data?: any,
+    onPreview?: PreviewCallback,
+    transfer: Transferable[] = []
+  ): Promise<any> {
     return new Promise((resolve, reject) => {
       if (!this.worker) {
         reject(new Error("Worker not initialized"))
@@ -77,31 +161,168 @@ export class LibRawClient {
       }
       
       const id = String(++this.messageId)
-      this.pending.set(id, { resolve, reject })
+      this.pending.set(id, { resolve, reject, onPreview })
       
       const message: WorkerMessage = { type, id, data }
-      this.worker.postMessage(message)
+      this.worker.postMessage(message, transfer)
     })
   }
 
   async loadFile(file: File): Promise<PhotoMetadata> {
-    const buffer = await file.arrayBuffer()
-    const result = await this.sendMessage("load", { buffer })
+    // The worker reads the file itself, so it is never copied on this thread
+    this.cachedPreview = null
+    const result = await this.sendMessage("load", { file })
+    this.cachedPreview = result.preview ?? null
     return result.metadata
   }
 
-  async process(params: ProcessParams): Promise<ImageData> {
-    const result = await this.sendMessage("process", { params })
+  // Last render of the loaded file from the unpacked cache, a better
+  // stand-in than the embedded thumbnail; null when it was not cached
+  getCachedPreview(): Blob | null {
+    return this.cachedPreview
+  }
+
+  // Resolves with null when a newer process request superseded this one
+  async process(params: ProcessParams): Promise<ImageData | null> {
+    const result = await this.queueRender("process", { params, progressive: false })
+    return result ? toImageData(result) : null
+  }
+  
+  // Calls onPreview with a smaller proxy first (a binned or half-size
+  // render, scale full-size pixels per pixel), then resolves with the
+  // full-quality image, or with null when a newer process request
+  // superseded this one. Previews may come from the frame ring, whose
+  // ImageData a later preview reuses: copy one to keep it.
+  async processProgressive(
+    params: ProcessParams,
+    onPreview: PreviewCallback
+  ): Promise<ImageData | null> {
+    const result = await this.queueRender("process", { params, progressive: true }, onPreview)
+    return result ? toImageData(result) : null
+  }
+  
+  // Renders only region (full-size output pixels) of the loaded file, e.g.
+  // what a zoomed view shows. Coalesced with process() requests: either
+  // kind supersedes the other. Like previews, the image may be reused by a
+  // later region render.
+  async processRegion(params: ProcessParams, region: ImageRegion, scale = 1): Promise<RegionImage | null> {
+    const result = await this.queueRender("process-region", { params, region, scale })
+    return result ? { image: toImageData(result), region: result.region } : null
+  }
+  
+  private queueRender(
+    type: RenderJob["type"],
+    data: Record<string, unknown>,
+    onPreview?: PreviewCallback
+  ): Promise<any> {
+    return new Promise((resolve, reject) => {
+      // Last write wins: a request still waiting for the worker is dropped
+      this.queuedRender?.resolve(null)
+      
+      const seq = ++this.renderSeq
+      this.queuedRender = { seq, type, data, onPreview, resolve, reject }
+      
+      if (this.renderInFlight) {
+        this.cancelRendersBefore(seq)
+      } else {
+        this.runQueuedRender()
+      }
+    })
+  }
+  
+  // Tells the worker that renders older than seq are out of date. Through
+  // the shared signal this also reaches a render that blocks the worker;
+  // a message is only seen between renders.
+  private cancelRendersBefore(seq: number) {
+    if (this.cancelSignal) {
+      Atomics.store(this.cancelSignal, 0, seq)
+    } else if (this.worker) {
+      const message: WorkerMessage = { type: "cancel", id: "", data: { seq } }
+      this.worker.postMessage(message)
+    }
+  }
+  
+  private async runQueuedRender() {
+    const job = this.queuedRender
+    if (this.renderInFlight || !job) return
     
-    // Reconstruct ImageData from transferred buffer
-    const data = new Uint8ClampedArray(result.data)
-    return new ImageData(data, result.width, result.height)
+    this.queuedRender = null
+    this.renderInFlight = true
+    try {
+      const result = await this.sendMessage(
+        job.type,
+        { ...job.data, seq: job.seq, cancelSignal: this.cancelSignal },
+        job.onPreview
+      )
+      // null: cancelled by the worker
+      job.resolve(result ?? null)
+    } catch (error) {
+      job.reject(error instanceof Error ? error : new Error(String(error)))
+    } finally {
+      this.renderInFlight = false
+      this.runQueuedRender()
+    }
+  }
+  
+  // Full render of params at 16 bits per channel without the output gamma.
+  // Not coalesced with process() requests; null when the build has no
+  // 16-bit output.
+  async processLinear(params: ProcessParams, format: LinearFormat = "float16"): Promise<LinearImage | null> {
+    const result = await this.sendMessage("process-linear", { params, format })
+    return result ? { ...result, data: new Uint16Array(result.data) } : null
+  }
+
+  // Full render of params encoded as a file in the worker. Not coalesced
+  // with process() requests, so an export is never dropped; null when the
+  // build cannot encode options.format.
+  async encode(params: ProcessParams, options: EncodeOptions): Promise<EncodedImage | null> {
+    const result = await this.sendMessage("encode", { params, options })
+    return result ? { ...result, data: new Uint8Array(result.data) } : null
   }
   
   async getThumbnail(): Promise<ThumbnailData | null> {
     return this.sendMessage("get-thumbnail")
   }
 
+  // Metadata and the largest embedded preview, without unpacking unless
+  // the preview is missing or smaller than minSize. Whatever file the
+  // worker has loaded stays loaded.
+  async extractThumbnail(file: File, options: { minSize?: number } = {}): Promise<ExtractedThumbnail> {
+    return this.sendMessage("get-thumbnail-only", { file, minSize: options.minSize })
+  }
+
+  // MetaISP output ([3, srcHeight, srcWidth] floats) to RGBA8, converted
+  // in the worker. A tensor that owns its whole buffer is transferred and
+  // unusable afterwards; anything else is copied.
+  async convertTensor(
+    tensor: Float32Array,
+    srcWidth: number,
+    srcHeight: number,
+    options: TensorConversionOptions = {}
+  ): Promise<ImageData> {
+    const buffer = tensor.buffer
+    const owned = buffer instanceof ArrayBuffer && tensor.byteOffset === 0 && tensor.byteLength === buffer.byteLength
+    const result = await this.sendMessage(
+      "convert-tensor",
+      { tensor, srcWidth, srcHeight, options },
+      undefined,
+      owned ? [buffer] : []
+    )
+    return toImageData(result)
+  }
+
+  // Size of the worker's WASM heap in bytes, null when the build can't tell
+  async getHeapSize(): Promise<number | null> {
+    const result = await this.sendMessage("get-heap-size")
+    return result.heapSize
+  }
+
+  // Heap use and the memory strategy of the worker's last render
+  async getMemoryStats(): Promise<MemoryStats | null> {
+    const result = await this.sendMessage("get-memory-stats")
+    return result.stats
+  }
+
   async dispose(): Promise<void> {
     try {
       if (this.worker) {
@@ -120,6 +341,61 @@ export class LibRawClient {
   }
 }
 
+// Shared with the worker so that it can see superseded renders while busy.
+// SharedArrayBuffer requires cross-origin isolation (see next.config.mjs).
+function createCancelSignal(): Int32Array | null {
+  if (typeof SharedArrayBuffer === "undefined" || typeof crossOriginIsolated === "undefined" || !crossOriginIsolated) {
+    return null
+  }
+  return new Int32Array(new SharedArrayBuffer(4))
+}
+
+// Number of ImageData each kind of ring frame cycles through
+const FRAME_IMAGES = 3
+
+// ImageData for ring frames, recycled per kind ('preview', 'region') and
+// size. A frame stays intact until FRAME_IMAGES newer frames of its kind
+// came in, long after the next one replaced it on screen. ImageData cannot
+// wrap a SharedArrayBuffer, hence the copy.
+class FrameImagePool {
+  private pools = new Map<string, { images: ImageData[]; next: number }>()
+
+  take(kind: string, width: number, height: number): ImageData {
+    let pool = this.pools.get(kind)
+    const first = pool?.images[0]
+    if (!pool || (first && (first.width !== width || first.height !== height))) {
+      pool = { images: [], next: 0 }
+      this.pools.set(kind, pool)
+    }
+    
+    let image = pool.images[pool.next]
+    if (!image) {
+      image = new ImageData(width, height)
+      pool.images[pool.next] = image
+    }
+    pool.next = (pool.next + 1) % FRAME_IMAGES
+    return image
+  }
+}
+
+// Analysis that came with each image, readable through getImageAnalysis()
+const analyses = new WeakMap<ImageData, ImageAnalysis>()
+
+// Reconstruct ImageData from transferred buffer, or take the one of a
+// ring frame
+function toImageData(result: { data?: ArrayBuffer; image?: ImageData; width: number; height: number; analysis?: ImageAnalysis }): ImageData {
+  const image = result.image ?? new ImageData(new Uint8ClampedArray(result.data!), result.width, result.height)
+  if (result.analysis) analyses.set(image, result.analysis)
+  else analyses.delete(image)
+  return image
+}
+
+// Histograms and statistics the worker computed for image, null when the
+// build has no analysis pass (or image did not come from the worker)
+export function getImageAnalysis(image: ImageData): ImageAnalysis | null {
+  return analyses.get(image) ?? null
+}
+
 // Singleton instance
 let clientInstance: LibRawClient | null = null
 
@@ -0,0 +1,50 @@
+import { describe, it, expect, afterEach, vi } from 'vitest'
+import { FrameRing, FRAME_SLOTS } from './frame-ring'
+
+describe('FrameRing', () => {
+  afterEach(() => {
+    vi.unstubAllGlobals()
+  })
+
+  it('should need cross-origin isolation', () => {
+    vi.stubGlobal('crossOriginIsolated', false)
+    expect(FrameRing.create(1024)).toBeNull()
+  })
+
+  it('should round slots up to whole megabytes', () => {
+    vi.stubGlobal('crossOriginIsolated', true)
+    const ring = FrameRing.create(1024)!
+
+    expect(ring.slotBytes).toBe(1 << 20)
+    expect(ring.view(1, 1024).byteOffset % 64).toBe(0)
+  })
+
+  it('should hand out each slot once until it is released', () => {
+    vi.stubGlobal('crossOriginIsolated', true)
+    const ring = FrameRing.create(16)!
+
+    const slots = Array.from({ length: FRAME_SLOTS }, () => ring.acquire())
+    expect(new Set(slots).size).toBe(FRAME_SLOTS)
+    expect(ring.acquire()).toBe(-1)
+
+    ring.publish(slots[1])
+    expect(ring.acquire()).toBe(-1)
+    ring.release(slots[1])
+    expect(ring.acquire()).toBe(slots[1])
+  })
+
+  it('should share the slots with the other side', () => {
+    vi.stubGlobal('crossOriginIsolated', true)
+    const ring = FrameRing.create(4)!
+    const slot = ring.acquire()
+    ring.view(slot, 4).set([1, 2, 3, 4])
+
+    const other = FrameRing.from(ring.buffer)
+    expect(Array.from(other.view(slot, 4))).toEqual([1, 2, 3, 4])
+    expect(ring.slotOf(ring.view(slot, 4))).toBe(slot)
+    expect(ring.slotOf(new Uint8Array(4))).toBe(-1)
+
+    other.release(slot)
+    expect(ring.acquire()).toBe(slot)
+  })
+})
@@ -0,0 +1,86 @@
+// Frame buffers shared by the worker and the client in one
+// SharedArrayBuffer, for the frames that are replaced as soon as the next
+// one arrives: progressive previews and region renders. The worker renders
+// into a free slot instead of a new buffer and posts only the slot; the
+// client copies it out into a recycled ImageData and hands the slot back.
+// Slot ownership goes through Atomics, so neither side waits for the
+// other: a worker that finds every slot taken renders into a buffer of its
+// own, as without a ring.
+//
+// SharedArrayBuffer requires cross-origin isolation (see next.config.mjs).
+
+export const FRAME_SLOTS = 3
+
+// Slots are rounded up to this, so that frames of about the same size (a
+// resized viewport) keep using the same ring
+const SLOT_ALIGN = 1 << 20
+
+// Slot states; the header is padded to keep the slots 64-byte aligned
+const FREE = 0
+const WRITING = 1
+const READY = 2
+const HEADER_BYTES = 64
+
+// What a 'preview' or 'region' response carries instead of its pixels.
+// ring is only sent with the first frame of a new ring.
+export interface RingFrame {
+  slot: number
+  byteLength: number
+  ring?: SharedArrayBuffer
+}
+
+export class FrameRing {
+  readonly slotBytes: number
+  private readonly states: Int32Array
+
+  private constructor(readonly buffer: SharedArrayBuffer) {
+    this.slotBytes = (buffer.byteLength - HEADER_BYTES) / FRAME_SLOTS
+    this.states = new Int32Array(buffer, 0, FRAME_SLOTS)
+  }
+
+  static isSupported(): boolean {
+    return typeof SharedArrayBuffer !== "undefined" && typeof crossOriginIsolated !== "undefined" && crossOriginIsolated
+  }
+
+  // Ring for frames of up to byteLength, null without cross-origin isolation
+  static create(byteLength: number): FrameRing | null {
+    if (!FrameRing.isSupported()) return null
+    const slotBytes = Math.ceil(byteLength / SLOT_ALIGN) * SLOT_ALIGN
+    return new FrameRing(new SharedArrayBuffer(HEADER_BYTES + slotBytes * FRAME_SLOTS))
+  }
+
+  // The other side's view of a ring the worker created
+  static from(buffer: SharedArrayBuffer): FrameRing {
+    return new FrameRing(buffer)
+  }
+
+  // Worker: claims a free slot, -1 when the client still holds all of them
+  acquire(): number {
+    for (let slot = 0; slot < FRAME_SLOTS; slot++) {
+      if (Atomics.compareExchange(this.states, slot, FREE, WRITING) === FREE) return slot
+    }
+    return -1
+  }
+
+  // The first byteLength bytes of slot
+  view(slot: number, byteLength: number): Uint8Array {
+    return new Uint8Array(this.buffer, HEADER_BYTES + slot * this.slotBytes, byteLength)
+  }
+
+  // Slot that data is a view of, -1 when it is not in this ring
+  slotOf(data: ArrayBufferView): number {
+    if (data.buffer !== this.buffer) return -1
+    return Math.floor((data.byteOffset - HEADER_BYTES) / this.slotBytes)
+  }
+
+  // Worker: the frame in slot is complete and posted
+  publish(slot: number): void {
+    Atomics.store(this.states, slot, READY)
+  }
+
+  // Worker: slot was claimed but not written, e.g. the render failed.
+  // Client: the frame in slot has been copied out.
+  release(slot: number): void {
+    Atomics.store(this.states, slot, FREE)
+  }
+}
@@ -0,0 +1,57 @@
+import { describe, it, expect } from 'vitest'
+import { LibRawWASM, LibRawModule } from './index'
+
+// Module whose instances accept every setter and record the calls
+function createFakeModule(calls: Record<string, unknown[][]>): LibRawModule {
+  class FakeLibRaw {
+    constructor() {
+      return new Proxy(this, {
+        get(target: any, key) {
+          if (key in target) return target[key]
+          if (typeof key === 'string' && key.startsWith('set')) {
+            return (...args: unknown[]) => (calls[key] ??= []).push(args)
+          }
+          return undefined
+        },
+      })
+    }
+    loadFromUint8Array() { return true }
+    unpack() { return true }
+    process() { return true }
+    getMetadata() { return { make: 'Test', model: 'Camera', width: 6000, height: 4000 } }
+    getImageDataRGBA() { return { data: new Uint8Array(4), width: 1, height: 1 } }
+    getImageDataRGBA16() { return { data: new Uint16Array(4), width: 1, height: 1, format: 'uint16' } }
+    renderBinnedPreview(factor: number) { return { data: new Uint8Array(4), width: 1, height: 1, factor } }
+    delete() {}
+  }
+  return { LibRaw: FakeLibRaw } as unknown as LibRawModule
+}
+
+describe('LibRawWASM parameters', () => {
+  it('should restore the output curve after a linear render', async () => {
+    const calls: Record<string, unknown[][]> = {}
+    const processor = LibRawWASM.fromModule(createFakeModule(calls))
+    await processor.loadFile(new ArrayBuffer(8))
+
+    await processor.process({ quality: 3 })
+    await processor.processLinear({ quality: 3 })
+    expect(calls.setGamma.at(-1)).toEqual([1, 1])
+
+    await processor.process({ quality: 3 })
+    expect(calls.setGamma.at(-1)).toEqual([2.4, 12.92])
+
+    await processor.process({ quality: 3, gamma: [2.2, 4.5] })
+    expect(calls.setGamma.at(-1)).toEqual([2.2, 4.5])
+  })
+
+  it('should give binned previews their scale and honour cancellation', async () => {
+    const processor = LibRawWASM.fromModule(createFakeModule({}))
+    await processor.loadFile(new ArrayBuffer(8))
+
+    const preview = await processor.renderBinnedPreview({ quality: 3 })
+    expect(preview?.scale).toBe(4)
+
+    await expect(processor.renderBinnedPreview({ quality: 3 }, undefined, { isCancelled: () => true }))
+      .rejects.toThrow('Render cancelled')
+  })
+})
@@ -1,23 +1,101 @@
-import { LibRawProcessor, ProcessParams, ProcessedImage, PhotoMetadata, ThumbnailData, ChannelData, BayerData } from "@/lib/types"
-import { loadLibRawModule } from "./libraw-loader"
+import { LibRawProcessor, ProcessParams, ProcessedImage, EncodeOptions, EncodedImage, PhotoMetadata, ThumbnailData, ExtractedThumbnail, ChannelData, BayerData, PipelineStats, StageTimings, MemoryStats, RenderOptions, LinearFormat, LinearImage, ImageRegion, ImageAnalysis, TensorConversionOptions, ColorPipelineInput, UnpackedSnapshot } from "@/lib/types"
+import { loadLibRawModule, LibRawModuleOptions } from "./libraw-loader"
+import { rgbToRgba } from "@/lib/utils/image-utils"
+import { expandLook, lookArgs } from "./look"
 
-// LibRaw WASM module interface
-interface LibRawModule {
+// LibRaw WASM module interface, which the Node addon build
+// (node/index.cjs in the LibRaw tree) has as well
+export interface LibRawModule {
   LibRaw: {
     new(): LibRawInstance
     getVersion(): string
     getCameraCount(): number
-    getCameraList(): string[]
+    // Built once per module and frozen
+    getCameraList(): readonly string[]
+    // Present in builds with the threaded demosaic (libraw-mt.js)
+    isThreaded?(): boolean
+    getMaxThreads?(): number
+    // Present in builds with SIMD128 kernels (libraw-simd.js, libraw-mt.js)
+    hasSIMD?(): boolean
+    // WASM heap size in bytes (optional, newer builds)
+    getHeapSize?(): number
+    // CHW float at srcPtr to RGBA8 at dstPtr (optional, newer builds)
+    convertTensorToRGBA?(srcPtr: number, srcWidth: number, srcHeight: number, dstPtr: number, width: number, height: number, srgb: boolean): boolean
+    // False in builds without libjpeg (optional, newer builds)
+    hasJPEGEncoder?(): boolean
   }
+  // Heap access for packMetaISPInputs() and convertTensorToRGBA()
+  // (HEAPU8 and HEAPF32 exported by newer builds)
+  _malloc?(size: number): number
+  _free?(ptr: number): void
+  HEAPU8?: Uint8Array
+  HEAPF32?: Float32Array
+}
+
+interface EncodedView {
+  width: number
+  height: number
+  bits: number
+  data: Uint8Array
+}
+
+// PNG is mostly an intermediate for further editing, so favor speed over size
+const PNG_LEVEL = 3
+const DEFAULT_JPEG_QUALITY = 90
+
+const MIME_TYPES: Record<EncodeOptions["format"], string> = {
+  jpeg: "image/jpeg",
+  png: "image/png",
+  tiff: "image/tiff",
 }
 
 interface LibRawInstance {
   loadFromUint8Array(data: Uint8Array): boolean
+  // Owned input buffer filled in chunks (optional, newer builds)
+  allocateInput?(size: number): boolean
+  writeInput?(chunk: Uint8Array, offset: number): boolean
+  openInput?(): boolean
+  recycle?(): void
+  // Opens through a JS source read on demand (optional, newer builds)
+  openFromBlob?(source: BlobSource): boolean
+  getStreamStats?(): { size: number; bytesRead: number; reads: number } | null
+  // Unpacked-state snapshots; the restore reads the input buffer (optional, newer builds)
+  getUnpackedSnapshotSize?(): number
+  writeUnpackedSnapshot?(dstPtr: number, length: number): boolean
+  loadFromUnpackedCache?(): boolean
   unpack(): boolean
   process(): any
+  // Renders one rectangle of the output (optional, newer builds). Returns
+  // getImageDataRGBA()'s result plus the region covered, null on failure.
+  processRegion?(x: number, y: number, width: number, height: number, scale: number): any
   getImageData(): any
+  // RGBA8 view over a reusable WASM heap buffer (optional, newer builds)
+  getImageDataRGBA?(): any
+  // The same buffer at 16 bits per channel, as half floats with half
+  // (optional, newer builds)
+  getImageDataRGBA16?(half: boolean): any
+  releaseImageData?(): void
+  // Files of the last process() output, viewing the heap until the next
+  // encode or releaseEncodedImage() (optional, newer builds)
+  encodeJPEG?(quality: number): EncodedView | null
+  encodePNG?(bits: number, level: number): EncodedView | null
+  encodeTIFF?(bits: number): EncodedView | null
+  releaseEncodedImage?(): void
+  // getImageDataRGBA() also returns clip bitsets (optional, newer builds)
+  setClipMasks?(enabled: boolean): void
+  // MetaISP inputs packed into _malloc()ed heap memory (optional, newer builds)
+  getMetaISPLayout?(): { width: number; height: number; cfa: string; black: number[]; maximum: number } | null
+  packMetaISPInputs?(rawPtr: number, rgbPtr: number, x: number, y: number, width: number, height: number, half: boolean): boolean
+  // Black-subtracted Bayer view and color metadata (optional, newer builds)
+  getColorPipelineInput?(): ColorPipelineInput | null
   getMetadata(): any
   getThumbnail(): any
+  // Open, read metadata and the largest preview, recycle (optional, newer builds)
+  extractThumbnail?(data: Uint8Array): { metadata: any; thumbnail: any } | null
+  extractThumbnailFromBlob?(source: BlobSource): { metadata: any; thumbnail: any } | null
+  // RGBA8 from factor x factor blocks of the raw data, no demosaic; null
+  // for sensors it cannot bin (optional, newer builds)
+  renderBinnedPreview?(factor: number): { data: Uint8Array; width: number; height: number; factor: number } | null
   
   // Processing parameters
   setUseCameraWB(value: number): void
@@ -42,6 +120,9 @@ interface LibRawInstance {
   setUserBlack(level: number): void
   setAberrationCorrection(r: number, b: number): void
   setSaturation?(saturation: number): void
+  // Look stage in the copy-out, all 0 for none (optional, newer builds)
+  setLook?(exposure: number, contrast: number, highlights: number, shadows: number,
+           whites: number, blacks: number, saturation: number, vibrance: number): void
   setVibrance?(vibrance: number): void
   
   // Advanced methods (optional for backward compatibility)
@@ -54,31 +135,177 @@ interface LibRawInstance {
   get4ChannelData?(): any
   getRawBayerData?(): any
   
+  // Staged pipeline cache (optional, older builds always run the full pipeline)
+  getPipelineStats?(): PipelineStats
+  invalidatePipelineCache?(): void
+  canReuseDemosaic?(): boolean
+  setPipelineCapture?(enabled: boolean): void
+  
+  // Per-stage wall-clock timings of the last run (optional, newer builds)
+  getStageTimings?(): StageTimings
+  
+  // Heap telemetry and memory-budgeted processing (optional, newer builds)
+  getMemoryStats?(): MemoryStats
+  setMemoryBudget?(bytes: number): void
+  
+  // Cancellation polled at LibRaw progress steps (optional, newer builds)
+  setCancelCheck?(check: (() => boolean) | null): void
+  cancel?(): void
+  wasCancelled?(): boolean
+  
+  // Demosaic threads (libraw-mt.js only, defaults to hardwareConcurrency)
+  setThreadCount?(count: number): void
+  getThreadCount?(): number
+  
   // Debug
   setDebugMode(value: boolean): void
   getDebugMode(): boolean
   getLastError(): string
   getProcessingInfo(): any
+  
+  // Embind handle, runs the C++ destructor
+  delete?(): void
+}
+
+// Heap bytes copied per chunk of a createUnpackedSnapshot() stream
+const SNAPSHOT_CHUNK_BYTES = 4 * 1024 * 1024
+
+// Synchronous random access to a file, for openFromBlob()
+interface BlobSource {
+  size: number
+  read(offset: number, length: number): Uint8Array
+}
+
+// FileReaderSync only exists in workers
+function createBlobSource(file: Blob): BlobSource | null {
+  const FileReaderSyncCtor = (self as any).FileReaderSync
+  if (typeof FileReaderSyncCtor !== 'function') {
+    return null
+  }
+  const reader = new FileReaderSyncCtor()
+  return {
+    size: file.size,
+    read: (offset, length) => new Uint8Array(reader.readAsArrayBuffer(file.slice(offset, offset + length))),
+  }
+}
+
+// rgba.data aliases the WASM heap and is invalidated by the next call into
+// the module (or heap growth), so copy it now. Same-type set() is a plain
+// memcpy, and the result owns a transferable ArrayBuffer even when the heap
+// is a SharedArrayBuffer, unless output provided the buffer.
+function copyRGBA(rgba: { data: Uint8Array; width: number; height: number; analysis?: any }, output?: RenderOptions['output']) {
+  const bytes = output?.(rgba.data.length) ?? new Uint8Array(rgba.data.length)
+  bytes.set(rgba.data)
+  return {
+    data: new Uint8ClampedArray(bytes.buffer, bytes.byteOffset, bytes.length),
+    width: rgba.width,
+    height: rgba.height,
+    analysis: rgba.analysis ? copyAnalysis(rgba.analysis) : undefined,
+  }
+}
+
+// The analysis arrays are heap views too. They are copied into one buffer
+// so that the worker transfers them with a single extra entry.
+function copyAnalysis(analysis: any): ImageAnalysis {
+  const histogramLength = analysis.histogram.length
+  const linearLength = analysis.linearHistogram.length
+  const maskBytes = analysis.clipMasks ? analysis.clipMasks.length : 0
+  const buffer = new ArrayBuffer((histogramLength + linearLength) * 4 + maskBytes)
+  
+  const histogram = new Uint32Array(buffer, 0, histogramLength)
+  histogram.set(analysis.histogram)
+  const linearHistogram = new Uint32Array(buffer, histogramLength * 4, linearLength)
+  linearHistogram.set(analysis.linearHistogram)
+  let clipMasks: Uint8Array | null = null
+  if (analysis.clipMasks) {
+    clipMasks = new Uint8Array(buffer, (histogramLength + linearLength) * 4, maskBytes)
+    clipMasks.set(analysis.clipMasks)
+  }
+  
+  return {
+    histogram,
+    linearHistogram,
+    clipMasks,
+    mean: [...analysis.mean],
+    p1: [...analysis.p1],
+    median: [...analysis.median],
+    p99: [...analysis.p99],
+    highlightClipped: [...analysis.highlightClipped],
+    shadowClipped: [...analysis.shadowClipped],
+  }
+}
+
+function toPhotoMetadata(meta: any): PhotoMetadata {
+  return {
+    camera: `${meta.make || 'Unknown'} ${meta.model || 'Unknown'}`,
+    lens: meta.lens || "Unknown",
+    iso: meta.iso || 0,
+    aperture: meta.aperture || 0,
+    shutterSpeed: meta.shutter ? `${meta.shutter}s` : "Unknown",
+    focalLength: meta.focalLength || 0,
+    date: meta.timestamp ? new Date(meta.timestamp * 1000) : new Date(),
+    width: meta.width || 0,
+    height: meta.height || 0,
+  }
+}
+
+// Output curve of renders without params.gamma, the module's default
+// (sRGB), as setGamma() power and toe
+const DEFAULT_GAMMA: [number, number] = [2.4, 12.92]
+
+// Longest side of a binned preview: grid cells and first paint
+export const BINNED_PREVIEW_SIZE = 1600
+
+// Smallest block size that brings width x height within maxSide. Blocks
+// cover whole CFA periods, so the factor is even, and the native side
+// caps it at 16.
+export function binnedPreviewFactor(width: number, height: number, maxSide: number): number {
+  const factor = Math.ceil(Math.max(width, height) / Math.max(maxSide, 1))
+  return Math.min(16, Math.max(2, factor + (factor & 1)))
+}
+
+function toThumbnailData(thumbnailData: any): ThumbnailData {
+  return {
+    format: thumbnailData.format,
+    width: thumbnailData.width,
+    height: thumbnailData.height,
+    data: new Uint8Array(thumbnailData.data)
+  }
 }
 
 // Dynamic import wrapper for LibRaw WASM
 export class LibRawWASM implements LibRawProcessor {
   private module: LibRawModule | null = null
   private instance: LibRawInstance | null = null
+  // Separate instance for extractThumbnail(), recycled after every file
+  private thumbnailInstance: LibRawInstance | null = null
   private loaded = false
+  private unpacked = false
+  // JS side of the last readImageData(), added to the module's copyOut
+  private lastCopyMs = 0
 
-  static async create(): Promise<LibRawWASM> {
+  static async create(options: LibRawModuleOptions = {}): Promise<LibRawWASM> {
     const processor = new LibRawWASM()
-    await processor.init()
+    await processor.init(options)
     return processor
   }
 
-  private async init(): Promise<void> {
+  // Over a module loaded elsewhere, e.g. the Node addon on a server:
+  //   LibRawWASM.fromModule(await (await import("libraw/node/index.cjs")).default())
+  // Without _malloc and HEAPU8 the heap-backed paths return null, as with
+  // older WASM builds.
+  static fromModule(module: LibRawModule): LibRawWASM {
+    const processor = new LibRawWASM()
+    processor.module = module
+    return processor
+  }
+
+  private async init(options: LibRawModuleOptions): Promise<void> {
     try {
       console.log("Initializing LibRaw WASM module...")
       
       // Load the LibRaw module using the loader
-      this.module = await loadLibRawModule()
+      this.module = await loadLibRawModule(options)
       
       console.log("LibRaw WASM initialized successfully")
       console.log("LibRaw version:", this.module.LibRaw.getVersion())
@@ -90,15 +317,144 @@ export class LibRawWASM implements LibRawProcessor {
   }
 
   async loadFile(buffer: ArrayBuffer): Promise<void> {
-    if (!this.module) {
-      throw new Error("LibRaw not initialized")
+    const instance = this.createInstance()
+    
+    // Load the RAW file
+    const loadSuccess = instance.loadFromUint8Array(new Uint8Array(buffer))
+    if (!loadSuccess) {
+      throw new Error("Failed to load RAW file")
     }
+    
+    this.loaded = true
+  }
 
-    // Create new instance for each file
-    if (this.instance) {
-      this.instance = null
+  // Opens the file without holding it as a whole in a JS ArrayBuffer. In a
+  // worker LibRaw reads byte ranges on demand, so metadata and thumbnail
+  // are available after reading the header, and the raw data is only read
+  // by the first process(). Otherwise the file is streamed into the heap.
+  async loadBlob(file: Blob): Promise<void> {
+    const instance = this.createInstance()
+    
+    const source = typeof instance.openFromBlob === 'function' ? createBlobSource(file) : null
+    if (source) {
+      if (!instance.openFromBlob!(source)) {
+        throw new Error("Failed to load RAW file")
+      }
+      if (process.env.NODE_ENV === 'development') {
+        const stats = instance.getStreamStats?.()
+        if (stats) {
+          console.log(`LibRaw opened after reading ${stats.bytesRead} of ${stats.size} bytes`)
+        }
+      }
+      this.loaded = true
+      return
+    }
+    
+    if (typeof instance.allocateInput !== 'function' || typeof file.stream !== 'function') {
+      // Older builds only accept a complete buffer
+      return this.loadFile(await file.arrayBuffer())
+    }
+    
+    if (!instance.allocateInput(file.size)) {
+      throw new Error(`Failed to allocate ${file.size} bytes for RAW file`)
+    }
+    
+    if (!(await this.fillInput(instance, file.stream(), file.size)) || !instance.openInput!()) {
+      throw new Error("Failed to load RAW file")
+    }
+    
+    this.loaded = true
+  }
+
+  // Restores a createUnpackedSnapshot() copy in place of loadFile() and
+  // unpack(). false when this build or the snapshot's build cannot.
+  async loadUnpackedSnapshot(snapshot: UnpackedSnapshot): Promise<boolean> {
+    const instance = this.createInstance()
+    if (typeof instance.loadFromUnpackedCache !== 'function' || !instance.allocateInput?.(snapshot.size)) {
+      return false
+    }
+    
+    if (!(await this.fillInput(instance, snapshot.stream, snapshot.size)) || !instance.loadFromUnpackedCache()) {
+      instance.recycle?.()
+      return false
+    }
+    
+    this.loaded = true
+    this.unpacked = true
+    return true
+  }
+
+  // Snapshot of the unpacked file, streamed off the heap in chunks. null
+  // when the build lacks snapshots or the layout is not supported.
+  createUnpackedSnapshot(): UnpackedSnapshot | null {
+    const instance = this.instance
+    const module = this.module
+    if (!instance || !this.loaded || typeof instance.getUnpackedSnapshotSize !== 'function' ||
+        !module?._malloc || !module._free || !module.HEAPU8) {
+      return null
     }
     
+    this.ensureUnpacked()
+    const size = instance.getUnpackedSnapshotSize()
+    const ptr = size ? module._malloc(size) : 0
+    if (!ptr) return null
+    if (!instance.writeUnpackedSnapshot!(ptr, size)) {
+      module._free(ptr)
+      return null
+    }
+    
+    let offset = 0
+    let released = false
+    const release = () => {
+      if (!released) module._free!(ptr)
+      released = true
+    }
+    const stream = new ReadableStream<Uint8Array>({
+      pull(controller) {
+        const end = Math.min(size, offset + SNAPSHOT_CHUNK_BYTES)
+        // slice() copies, so chunks outlive heap growth and the buffer
+        controller.enqueue(module.HEAPU8!.slice(ptr + offset, ptr + end))
+        offset = end
+        if (offset === size) {
+          release()
+          controller.close()
+        }
+      },
+      cancel: release,
+    })
+    return { size, stream }
+  }
+
+  // Streams into the buffer of allocateInput(size); false unless the
+  // stream yields exactly size bytes
+  private async fillInput(instance: LibRawInstance, stream: ReadableStream<Uint8Array>, size: number): Promise<boolean> {
+    const reader = stream.getReader()
+    let offset = 0
+    try {
+      for (;;) {
+        const { done, value } = await reader.read()
+        if (done) break
+        if (!instance.writeInput!(value, offset)) {
+          throw new Error("Failed to load RAW file")
+        }
+        offset += value.length
+      }
+    } catch (error) {
+      instance.recycle?.()
+      throw error
+    } finally {
+      reader.releaseLock()
+    }
+    return offset === size
+  }
+
+  // Create new instance for each file
+  private createInstance(): LibRawInstance {
+    if (!this.module) {
+      throw new Error("LibRaw not initialized")
+    }
+    
+    this.releaseInstance()
     this.instance = new this.module.LibRaw()
     
     // Enable debug mode only in development
@@ -106,64 +462,303 @@ export class LibRawWASM implements LibRawProcessor {
       this.instance.setDebugMode(process.env.NODE_ENV === 'development')
     }
     
-    // Convert ArrayBuffer to Uint8Array
-    const uint8Array = new Uint8Array(buffer)
-    
-    // Load the RAW file
-    const loadSuccess = this.instance.loadFromUint8Array(uint8Array)
-    if (!loadSuccess) {
-      throw new Error("Failed to load RAW file")
-    }
+    return this.instance
+  }
+
+  // Unpack the RAW data on first use; opening only parses metadata
+  private ensureUnpacked(): void {
+    if (this.unpacked) return
     
-    // Unpack the RAW data
-    const unpackSuccess = this.instance.unpack()
+    const unpackSuccess = this.instance!.unpack()
     if (!unpackSuccess) {
       throw new Error("Failed to unpack RAW file")
     }
     
-    this.loaded = true
+    this.unpacked = true
+  }
+
+  // Frees the WASM heap held by the current instance. Embind objects are not
+  // garbage collected, so without delete() the input buffer and decoded
+  // images of every opened file would stay on the heap.
+  private releaseInstance(): void {
+    if (this.instance) {
+      this.instance.releaseImageData?.()
+      this.instance.recycle?.()
+      this.instance.delete?.()
+      this.instance = null
+    }
+    this.loaded = false
+    this.unpacked = false
+  }
+
+  // Runs the native pipeline with params, leaving the output in the instance
+  private render(params: ProcessParams, options: RenderOptions): void {
+    if (!this.instance || !this.loaded) {
+      throw new Error("No file loaded")
+    }
+    
+    const { isCancelled } = options
+    if (isCancelled?.()) {
+      throw new DOMException("Render cancelled", "AbortError")
+    }
+    
+    this.ensureUnpacked()
+    this.applyParams(params)
+
+    // Process the image
+    const cacheDemosaic = options.cacheDemosaic ?? true
+    if (!cacheDemosaic) this.instance.setPipelineCapture?.(false)
+    if (isCancelled) this.instance.setCancelCheck?.(isCancelled)
+    let processSuccess
+    try {
+      processSuccess = this.instance.process()
+    } finally {
+      if (!cacheDemosaic) this.instance.setPipelineCapture?.(true)
+      if (isCancelled) this.instance.setCancelCheck?.(null)
+    }
+    if (!processSuccess && this.instance.wasCancelled?.()) {
+      throw new DOMException("Render cancelled", "AbortError")
+    }
+    if (!processSuccess) {
+      const error = this.instance.getLastError ? this.instance.getLastError() : "Unknown error"
+      throw new Error(`Failed to process RAW file: ${error}`)
+    }
+
+    if (process.env.NODE_ENV === 'development') {
+      const stats = this.getPipelineStats()
+      if (stats) {
+        console.log(`LibRaw process: ${stats.lastRun} run (full: ${stats.fullRuns}, tail: ${stats.tailRuns}, output: ${stats.outputRuns})`)
+      }
+      const timings = this.getStageTimings()
+      if (timings) {
+        const stages = Object.entries(timings.stages)
+          .map(([stage, ms]) => `${stage} ${ms.toFixed(1)}`)
+          .join(', ')
+        console.log(`LibRaw process: ${timings.process.toFixed(1)} ms (${stages}, other ${timings.other.toFixed(1)})`)
+      }
+      const memory = this.getMemoryStats()
+      if (memory && memory.strategy !== 'full') {
+        console.log(`LibRaw process: ${memory.strategy} run to fit ${(memory.budget / 1048576).toFixed(0)} MB (${memory.fallbacks} fallbacks)`)
+      }
+    }
+  }
+
+  async process(params: ProcessParams, options: RenderOptions = {}): Promise<ProcessedImage> {
+    this.render(params, options)
+    const { data, width, height, analysis } = this.readImageData(options.output)
+    
+    return {
+      data,
+      width,
+      height,
+      metadata: this.getMetadata(),
+      analysis,
+    }
+  }
+
+  // Renders params with a linear curve and copies the 16-bit output as is,
+  // for consumers that need more than 8 bits (HDR or float pipelines,
+  // analysis). null when the build lacks getImageDataRGBA16().
+  async processLinear(params: ProcessParams, format: LinearFormat = "float16", options: RenderOptions = {}): Promise<LinearImage | null> {
+    if (!this.instance || typeof this.instance.getImageDataRGBA16 !== "function") {
+      return null
+    }
+    
+    this.render({ ...params, gamma: [1, 1] }, options)
+    const started = performance.now()
+    try {
+      const rgba = this.instance.getImageDataRGBA16(format === "float16")
+      if (!rgba || !rgba.data) {
+        throw new Error("Failed to get 16-bit image data")
+      }
+      // slice() copies off the heap into a buffer the worker can transfer
+      return { data: rgba.data.slice(), width: rgba.width, height: rgba.height, format: rgba.format }
+    } finally {
+      this.lastCopyMs = performance.now() - started
+    }
+  }
+
+  // Renders params and encodes the file in the module, at up to 16 bits
+  // per sample for PNG and TIFF. null when the build lacks the encoder.
+  async encode(params: ProcessParams, options: EncodeOptions, renderOptions: RenderOptions = {}): Promise<EncodedImage | null> {
+    const instance = this.instance
+    const encoders = {
+      jpeg: instance?.encodeJPEG && this.module?.LibRaw.hasJPEGEncoder?.(),
+      png: instance?.encodePNG,
+      tiff: instance?.encodeTIFF,
+    }
+    if (!instance || !encoders[options.format] || typeof instance.releaseEncodedImage !== "function") {
+      return null
+    }
+    
+    this.render(params, renderOptions)
+    const bits = options.bits ?? 16
+    let encoded: EncodedView | null = null
+    try {
+      switch (options.format) {
+        case "jpeg":
+          encoded = instance.encodeJPEG!(options.quality ?? DEFAULT_JPEG_QUALITY)
+          break
+        case "png":
+          encoded = instance.encodePNG!(bits, PNG_LEVEL)
+          break
+        case "tiff":
+          encoded = instance.encodeTIFF!(bits)
+          break
+      }
+      if (!encoded) {
+        throw new Error(`Failed to encode ${options.format.toUpperCase()}`)
+      }
+      return {
+        // slice() copies off the heap into a buffer the worker can transfer
+        data: encoded.data.slice(),
+        mimeType: MIME_TYPES[options.format],
+        width: encoded.width,
+        height: encoded.height,
+        bits: encoded.bits,
+      }
+    } finally {
+      instance.releaseEncodedImage()
+    }
+  }
+
+  // Renders only region of the output image. Cut from the cached demosaic
+  // stage when process() left a matching one, so a zoomed view can follow
+  // parameter changes without rendering the whole frame.
+  async processRegion(
+    params: ProcessParams,
+    region: ImageRegion,
+    scale: number,
+    options: RenderOptions = {}
+  ): Promise<{ image: ProcessedImage; region: ImageRegion }> {
+    if (!this.instance || !this.loaded) {
+      throw new Error("No file loaded")
+    }
+    if (typeof this.instance.processRegion !== 'function') {
+      throw new Error("Region rendering is not supported by this LibRaw build")
+    }
+    
+    const { isCancelled } = options
+    if (isCancelled?.()) {
+      throw new DOMException("Render cancelled", "AbortError")
+    }
+    
+    this.ensureUnpacked()
+    this.applyParams(params)
+    
+    if (isCancelled) this.instance.setCancelCheck?.(isCancelled)
+    let rendered
+    try {
+      rendered = this.instance.processRegion(region.x, region.y, region.width, region.height, scale)
+    } finally {
+      if (isCancelled) this.instance.setCancelCheck?.(null)
+    }
+    if (!rendered && this.instance.wasCancelled?.()) {
+      throw new DOMException("Render cancelled", "AbortError")
+    }
+    if (!rendered || !rendered.data) {
+      throw new Error("Failed to render region")
+    }
+    
+    return {
+      image: { ...copyRGBA(rendered, options.output), metadata: this.getMetadata() },
+      region: { ...rendered.region },
+    }
+  }
+
+  // Whether process(params) would skip demosaic by reusing the cached stage
+  canReuseDemosaic(params: ProcessParams): boolean {
+    if (!this.instance || !this.loaded || typeof this.instance.canReuseDemosaic !== 'function') {
+      return false
+    }
+    this.applyParams(params)
+    return this.instance.canReuseDemosaic()
   }
 
-  async process(params: ProcessParams): Promise<ProcessedImage> {
+  // Display-size preview straight from the raw data: blocks of the sensor
+  // are averaged instead of demosaiced, and white balance, color, exposure
+  // and gamma follow params. Reads every raw sample once, so it is much
+  // cheaper than a half-size render. null when the build or the sensor
+  // (X-Trans, non-Bayer) cannot bin.
+  async renderBinnedPreview(
+    params: ProcessParams,
+    maxSide: number = BINNED_PREVIEW_SIZE,
+    options: RenderOptions = {}
+  ): Promise<ProcessedImage | null> {
     if (!this.instance || !this.loaded) {
       throw new Error("No file loaded")
     }
+    if (typeof this.instance.renderBinnedPreview !== 'function') {
+      return null
+    }
+    
+    // Binning takes one pass without stage boundaries, so it can only be
+    // cancelled before it starts or dropped once it is done
+    const { isCancelled } = options
+    if (isCancelled?.()) {
+      throw new DOMException("Render cancelled", "AbortError")
+    }
+    
+    this.ensureUnpacked()
+    this.applyParams(params)
+    
+    const metadata = this.getMetadata()
+    const rendered = this.instance.renderBinnedPreview(binnedPreviewFactor(metadata.width, metadata.height, maxSide))
+    if (isCancelled?.()) {
+      throw new DOMException("Render cancelled", "AbortError")
+    }
+    if (!rendered || !rendered.data) return null
+    
+    return { ...copyRGBA(rendered, options.output), metadata, scale: rendered.factor }
+  }
 
+  private applyParams(params: ProcessParams): void {
+    const instance = this.instance!
+    
+    // Older builds approximate the look with LibRaw parameters
+    if (typeof instance.setLook === 'function') {
+      const [exposure, contrast, highlights, shadows, whites, blacks, saturation, vibrance] = lookArgs(params.look)
+      instance.setLook(exposure, contrast, highlights, shadows, whites, blacks, saturation, vibrance)
+    } else {
+      params = expandLook(params)
+    }
+    
     // Set basic processing parameters
-    this.instance.setUseCameraWB(params.useCameraWB ? 1 : 0)
-    this.instance.setUseAutoWB(params.useAutoWB ? 1 : 0)
-    this.instance.setOutputColor(params.outputColor ?? 1) // Default to sRGB
-    this.instance.setBrightness(params.brightness ?? 1.0)
-    this.instance.setQuality(params.quality ?? 3) // Default to AHD
-    this.instance.setHalfSize(params.halfSize ? 1 : 0)
+    instance.setUseCameraWB(params.useCameraWB ? 1 : 0)
+    instance.setUseAutoWB(params.useAutoWB ? 1 : 0)
+    instance.setOutputColor(params.outputColor ?? 1) // Default to sRGB
+    instance.setBrightness(params.brightness ?? 1.0)
+    instance.setQuality(params.quality ?? 3) // Default to AHD
+    instance.setHalfSize(params.halfSize ? 1 : 0)
     
     // Set extended parameters if provided
     if (params.highlight !== undefined) {
-      this.instance.setHighlight(params.highlight)
+      instance.setHighlight(params.highlight)
     }
     
-    if (params.gamma) {
-      this.instance.setGamma(params.gamma[0], params.gamma[1])
-    }
+    // Always set: the module keeps the curve between renders, so a render
+    // without gamma would otherwise inherit processLinear()'s linear one
+    const [power, toe] = params.gamma ?? DEFAULT_GAMMA
+    instance.setGamma(power, toe)
     
     if (params.noiseThreshold !== undefined) {
-      this.instance.setNoiseThreshold(params.noiseThreshold)
+      instance.setNoiseThreshold(params.noiseThreshold)
     }
     
     if (params.medianPasses !== undefined) {
-      this.instance.setMedianPasses(params.medianPasses)
+      instance.setMedianPasses(params.medianPasses)
     }
     
     if (params.exposure) {
-      this.instance.setExposure(params.exposure.shift, params.exposure.preserve)
+      instance.setExposure(params.exposure.shift, params.exposure.preserve)
     }
     
     if (params.autoBright) {
-      this.instance.setAutoBright(params.autoBright.enabled, params.autoBright.threshold)
+      instance.setAutoBright(params.autoBright.enabled, params.autoBright.threshold)
     }
     
     if (params.customWB) {
-      this.instance.setCustomWB(
+      instance.setCustomWB(
         params.customWB.r,
         params.customWB.g1,
         params.customWB.g2,
@@ -172,48 +767,45 @@ export class LibRawWASM implements LibRawProcessor {
     }
     
     if (params.fourColorRGB !== undefined) {
-      this.instance.setFourColorRGB(params.fourColorRGB)
+      instance.setFourColorRGB(params.fourColorRGB)
     }
     
     if (params.dcbIterations !== undefined) {
-      this.instance.setDCBIterations(params.dcbIterations)
+      instance.setDCBIterations(params.dcbIterations)
     }
     
     if (params.dcbEnhance !== undefined) {
-      this.instance.setDCBEnhance(params.dcbEnhance)
+      instance.setDCBEnhance(params.dcbEnhance)
     }
     
     if (params.outputBPS !== undefined) {
-      this.instance.setOutputBPS(params.outputBPS)
+      instance.setOutputBPS(params.outputBPS)
     }
     
     if (params.userBlack !== undefined) {
-      this.instance.setUserBlack(params.userBlack)
+      instance.setUserBlack(params.userBlack)
     }
     
     if (params.aberrationCorrection) {
-      this.instance.setAberrationCorrection(
+      instance.setAberrationCorrection(
         params.aberrationCorrection.r,
         params.aberrationCorrection.b
       )
     }
     
     // Set advanced parameters if provided
-    if (params.shotSelect !== undefined && typeof this.instance.setShotSelect === 'function') {
-      this.instance.setShotSelect(params.shotSelect)
+    if (params.shotSelect !== undefined && typeof instance.setShotSelect === 'function') {
+      instance.setShotSelect(params.shotSelect)
     }
     
-    if (params.cropArea && typeof this.instance.setCropArea === 'function') {
-      this.instance.setCropArea(
-        params.cropArea.x1,
-        params.cropArea.y1,
-        params.cropArea.x2,
-        params.cropArea.y2
-      )
+    // The crop is cut on output, so clearing it costs nothing
+    if (typeof instance.setCropArea === 'function') {
+      const crop = params.cropArea
+      instance.setCropArea(crop?.x1 ?? 0, crop?.y1 ?? 0, crop?.x2 ?? 0, crop?.y2 ?? 0)
     }
     
-    if (params.greyBox && typeof this.instance.setGreyBox === 'function') {
-      this.instance.setGreyBox(
+    if (params.greyBox && typeof instance.setGreyBox === 'function') {
+      instance.setGreyBox(
         params.greyBox.x1,
         params.greyBox.y1,
         params.greyBox.x2,
@@ -221,36 +813,57 @@ export class LibRawWASM implements LibRawProcessor {
       )
     }
     
-    if (params.userFlip !== undefined && typeof this.instance.setUserFlip === 'function') {
-      this.instance.setUserFlip(params.userFlip)
+    if (params.userFlip !== undefined && typeof instance.setUserFlip === 'function') {
+      instance.setUserFlip(params.userFlip)
     }
     
-    if (params.noAutoBright !== undefined && typeof this.instance.setNoAutoBright === 'function') {
-      this.instance.setNoAutoBright(params.noAutoBright)
+    if (params.noAutoBright !== undefined && typeof instance.setNoAutoBright === 'function') {
+      instance.setNoAutoBright(params.noAutoBright)
     }
     
-    if (params.outputTiff !== undefined && typeof this.instance.setOutputTiff === 'function') {
-      this.instance.setOutputTiff(params.outputTiff)
+    if (params.outputTiff !== undefined && typeof instance.setOutputTiff === 'function') {
+      instance.setOutputTiff(params.outputTiff)
+    }
+    
+    if (params.clipMasks !== undefined && typeof instance.setClipMasks === 'function') {
+      instance.setClipMasks(params.clipMasks)
+    }
+    if (params.memoryBudget !== undefined && typeof instance.setMemoryBudget === 'function') {
+      instance.setMemoryBudget(params.memoryBudget)
     }
     
     // Color adjustments
-    if (params.saturation !== undefined && typeof this.instance.setSaturation === 'function') {
-      this.instance.setSaturation(params.saturation)
+    if (params.saturation !== undefined && typeof instance.setSaturation === 'function') {
+      instance.setSaturation(params.saturation)
     }
     
-    if (params.vibrance !== undefined && typeof this.instance.setVibrance === 'function') {
-      this.instance.setVibrance(params.vibrance)
+    if (params.vibrance !== undefined && typeof instance.setVibrance === 'function') {
+      instance.setVibrance(params.vibrance)
     }
+  }
 
-    // Process the image
-    const processSuccess = this.instance.process()
-    if (!processSuccess) {
-      const error = this.instance.getLastError ? this.instance.getLastError() : "Unknown error"
-      throw new Error(`Failed to process RAW file: ${error}`)
+  // Copies the rendered image out of the module exactly once
+  private readImageData(output?: RenderOptions['output']): { data: Uint8ClampedArray; width: number; height: number; analysis?: ImageAnalysis } {
+    const started = performance.now()
+    try {
+      return this.copyImageData(output)
+    } finally {
+      this.lastCopyMs = performance.now() - started
     }
+  }
 
-    // Get processed image data
-    const imageData = this.instance.getImageData()
+  private copyImageData(output?: RenderOptions['output']): { data: Uint8ClampedArray; width: number; height: number; analysis?: ImageAnalysis } {
+    const instance = this.instance!
+    
+    if (typeof instance.getImageDataRGBA === 'function') {
+      const rgba = instance.getImageDataRGBA()
+      if (rgba && rgba.data) {
+        return copyRGBA(rgba, output)
+      }
+    }
+    
+    // Older builds: getImageData() returns a JS copy of dcraw_make_mem_image()
+    const imageData = instance.getImageData()
     if (!imageData || !imageData.data) {
       throw new Error("Failed to get image data")
     }
@@ -259,34 +872,35 @@ export class LibRawWASM implements LibRawProcessor {
     const height = imageData.height
     const colors = imageData.colors || 3
     
-    // LibRaw returns RGB data, but ImageData needs RGBA
-    let data: Uint8ClampedArray
-    
     if (colors === 3) {
-      // Convert RGB to RGBA by adding alpha channel
-      const rgbData = new Uint8ClampedArray(imageData.data)
-      const rgbaData = new Uint8ClampedArray(width * height * 4)
-      
-      for (let i = 0; i < width * height; i++) {
-        rgbaData[i * 4] = rgbData[i * 3]       // R
-        rgbaData[i * 4 + 1] = rgbData[i * 3 + 1] // G
-        rgbaData[i * 4 + 2] = rgbData[i * 3 + 2] // B
-        rgbaData[i * 4 + 3] = 255                // A (fully opaque)
-      }
-      
-      data = rgbaData
+      // LibRaw returns RGB data, but ImageData needs RGBA
+      return { data: rgbToRgba(imageData.data, width * height), width, height }
     } else if (colors === 4) {
       // Already RGBA
-      data = new Uint8ClampedArray(imageData.data)
-    } else {
-      throw new Error(`Unsupported color format: ${colors} colors`)
+      return { data: new Uint8ClampedArray(imageData.data), width, height }
     }
-    
-    return {
-      data,
-      width,
-      height,
-      metadata: this.getMetadata(),
+    throw new Error(`Unsupported color format: ${colors} colors`)
+  }
+
+  getPipelineStats(): PipelineStats | null {
+    if (!this.instance || typeof this.instance.getPipelineStats !== 'function') {
+      return null
+    }
+    return this.instance.getPipelineStats()
+  }
+
+  getStageTimings(): StageTimings | null {
+    if (!this.instance || typeof this.instance.getStageTimings !== 'function') {
+      return null
+    }
+    const timings = this.instance.getStageTimings()
+    return { ...timings, copyOut: timings.copyOut + this.lastCopyMs }
+  }
+
+  // Force the next process() to re-run demosaic, e.g. after replacing the file data
+  invalidatePipelineCache(): void {
+    if (this.instance && typeof this.instance.invalidatePipelineCache === 'function') {
+      this.instance.invalidatePipelineCache()
     }
   }
 
@@ -300,17 +914,7 @@ export class LibRawWASM implements LibRawProcessor {
       throw new Error("No metadata available")
     }
     
-    return {
-      camera: `${meta.make || 'Unknown'} ${meta.model || 'Unknown'}`,
-      lens: meta.lens || "Unknown",
-      iso: meta.iso || 0,
-      aperture: meta.aperture || 0,
-      shutterSpeed: meta.shutter ? `${meta.shutter}s` : "Unknown",
-      focalLength: meta.focalLength || 0,
-      date: meta.timestamp ? new Date(meta.timestamp * 1000) : new Date(),
-      width: meta.width || 0,
-      height: meta.height || 0,
-    }
+    return toPhotoMetadata(meta)
   }
 
   getThumbnail(): ThumbnailData | null {
@@ -325,18 +929,78 @@ export class LibRawWASM implements LibRawProcessor {
       const thumbnailData = this.instance.getThumbnail()
       if (!thumbnailData) return null
 
-      return {
-        format: thumbnailData.format,
-        width: thumbnailData.width,
-        height: thumbnailData.height,
-        data: new Uint8Array(thumbnailData.data)
-      }
+      return toThumbnailData(thumbnailData)
     } catch (error) {
       console.error('Failed to get thumbnail:', error)
       return null
     }
   }
 
+  // Library fast path: opens the file on its own instance, takes metadata
+  // and the largest embedded preview and releases it again. Nothing is
+  // unpacked, and in a worker only the header and preview are read.
+  // Without a preview, or with one whose longest side is below minSize
+  // (common for DNG), the file is unpacked for a binned RGBA preview.
+  async extractThumbnail(file: Blob, options: { minSize?: number } = {}): Promise<ExtractedThumbnail> {
+    if (!this.module) {
+      throw new Error("LibRaw not initialized")
+    }
+    if (!this.thumbnailInstance) {
+      this.thumbnailInstance = new this.module.LibRaw()
+    }
+    const instance = this.thumbnailInstance
+    
+    let extracted: { metadata: any; thumbnail: any } | null = null
+    const source = typeof instance.extractThumbnailFromBlob === 'function' ? createBlobSource(file) : null
+    if (source) {
+      extracted = instance.extractThumbnailFromBlob!(source)
+    } else if (typeof instance.extractThumbnail === 'function') {
+      extracted = instance.extractThumbnail(new Uint8Array(await file.arrayBuffer()))
+    } else {
+      // Older builds: the same steps by hand
+      if (instance.loadFromUint8Array(new Uint8Array(await file.arrayBuffer()))) {
+        extracted = { metadata: instance.getMetadata(), thumbnail: instance.getThumbnail() }
+      }
+      instance.recycle?.()
+    }
+    
+    if (!extracted || !extracted.metadata) {
+      throw new Error("Failed to load RAW file")
+    }
+    
+    let thumbnail = extracted.thumbnail ? toThumbnailData(extracted.thumbnail) : null
+    const { minSize = 0 } = options
+    if (typeof instance.renderBinnedPreview === 'function' &&
+        (!thumbnail || Math.max(thumbnail.width, thumbnail.height) < minSize)) {
+      thumbnail = (await this.binnedThumbnail(instance, file, Math.max(minSize, 1))) ?? thumbnail
+    }
+    return {
+      metadata: toPhotoMetadata(extracted.metadata),
+      thumbnail,
+    }
+  }
+
+  // Opens file again on instance and bins it to about size pixels on the
+  // longest side, with the camera's white balance like an embedded preview
+  private async binnedThumbnail(instance: LibRawInstance, file: Blob, size: number): Promise<ThumbnailData | null> {
+    try {
+      if (!instance.loadFromUint8Array(new Uint8Array(await file.arrayBuffer())) || !instance.unpack()) {
+        return null
+      }
+      instance.setUseCameraWB(1)
+      instance.setOutputColor(1)
+      const meta = instance.getMetadata()
+      const rendered = instance.renderBinnedPreview!(binnedPreviewFactor(meta.width, meta.height, size))
+      if (!rendered || !rendered.data) return null
+      
+      const { data, width, height } = copyRGBA(rendered)
+      return { format: 'rgba', width, height, data: new Uint8Array(data.buffer) }
+    } finally {
+      instance.releaseImageData?.()
+      instance.recycle?.()
+    }
+  }
+
   get4ChannelData(): ChannelData | null {
     if (!this.instance || !this.loaded) {
       return null
@@ -346,6 +1010,7 @@ export class LibRawWASM implements LibRawProcessor {
       if (typeof this.instance.get4ChannelData !== 'function') {
         return null
       }
+      this.ensureUnpacked()
       const channelData = this.instance.get4ChannelData()
       if (!channelData) return null
 
@@ -370,6 +1035,7 @@ export class LibRawWASM implements LibRawProcessor {
       if (typeof this.instance.getRawBayerData !== 'function') {
         return null
       }
+      this.ensureUnpacked()
       const bayerData = this.instance.getRawBayerData()
       if (!bayerData) return null
 
@@ -385,12 +1051,73 @@ export class LibRawWASM implements LibRawProcessor {
     }
   }
 
-  dispose(): void {
-    if (this.instance) {
-      // LibRaw WASM doesn't have a dispose method, the destructor is called automatically
-      this.instance = null
+  // Input of the WebGL backend. data views the WASM heap: it is valid
+  // until the next call, releaseImageData() or heap growth.
+  getColorPipelineInput(): ColorPipelineInput | null {
+    if (!this.instance || !this.loaded || typeof this.instance.getColorPipelineInput !== 'function') {
+      return null
     }
-    this.loaded = false
+    this.ensureUnpacked()
+    return this.instance.getColorPipelineInput()
+  }
+
+  // Frees the native output buffers early, e.g. once their data is on the GPU
+  releaseImageData(): void {
+    this.instance?.releaseImageData?.()
+  }
+
+  // Heap of the whole module, which every instance in this context shares
+  getHeapSize(): number | null {
+    return this.module?.LibRaw.getHeapSize?.() ?? null
+  }
+
+  getMemoryStats(): MemoryStats | null {
+    if (!this.instance || typeof this.instance.getMemoryStats !== 'function') {
+      return null
+    }
+    return this.instance.getMemoryStats()
+  }
+
+  // Converts MetaISP output on the heap in one native pass. Needs no
+  // loaded file; null when the build has no convertTensorToRGBA().
+  convertTensor(
+    tensor: Float32Array,
+    srcWidth: number,
+    srcHeight: number,
+    options: TensorConversionOptions = {}
+  ): { data: Uint8ClampedArray; width: number; height: number } | null {
+    const module = this.module
+    if (!module?.LibRaw.convertTensorToRGBA || !module._malloc || !module._free || !module.HEAPF32 || !module.HEAPU8) {
+      return null
+    }
+
+    const width = options.width ?? srcWidth
+    const height = options.height ?? srcHeight
+    const outputBytes = width * height * 4
+    const src = module._malloc(tensor.length * 4)
+    const dst = src ? module._malloc(outputBytes) : 0
+    try {
+      if (!dst) {
+        throw new Error("Failed to allocate heap for tensor conversion")
+      }
+      // Views are taken after _malloc(), which may have grown the heap
+      module.HEAPF32.set(tensor, src >> 2)
+      if (!module.LibRaw.convertTensorToRGBA(src, srcWidth, srcHeight, dst, width, height, !!options.srgb)) {
+        return null
+      }
+      // slice() copies into a buffer of its own, which the worker can transfer
+      const data = new Uint8ClampedArray(module.HEAPU8.slice(dst, dst + outputBytes).buffer)
+      return { data, width, height }
+    } finally {
+      if (src) module._free(src)
+      if (dst) module._free(dst)
+    }
+  }
+
+  dispose(): void {
+    this.releaseInstance()
+    this.thumbnailInstance?.delete?.()
+    this.thumbnailInstance = null
   }
 
   // Static utility methods
@@ -1,9 +1,13 @@
 // LibRaw WASM module loader
 // Handles loading the LibRaw WASM module in different contexts (main thread vs worker)
 
-import { getLibRawModule } from './wasm-module-loader';
+import { getLibRawModule, getLibRawVariant, LibRawModuleOptions } from './wasm-module-loader';
 
-export async function loadLibRawModule(): Promise<any> {
-  // Use the cached module loader
-  return await getLibRawModule();
-}
\ No newline at end of file
+export { getLibRawVariant };
+export type { LibRawModuleOptions };
+
+export async function loadLibRawModule(options: LibRawModuleOptions = {}): Promise<any> {
+  // Use the cached module loader; picks the threaded build when the
+  // worker is crossOriginIsolated and falls back to libraw.js otherwise
+  return await getLibRawModule(options);
+}
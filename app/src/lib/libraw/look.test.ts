@@ -0,0 +1,32 @@
+import { describe, it, expect } from 'vitest'
+import { createTestEditParams } from '@/test/utils'
+import { editLook, expandLook, isNeutralLook, lookArgs } from './look'
+
+describe('look', () => {
+  it('should leave a neutral edit without a look', () => {
+    expect(editLook(createTestEditParams())).toBeUndefined()
+    expect(isNeutralLook({ exposure: 0, contrast: 0 })).toBe(true)
+    expect(isNeutralLook({ blacks: -10 })).toBe(false)
+  })
+
+  it('should pass the look in setLook order', () => {
+    const look = editLook(createTestEditParams({ exposure: 1, vibrance: 25 }))
+
+    expect(lookArgs(look)).toEqual([1, 0, 0, 0, 0, 0, 0, 25])
+    expect(lookArgs(undefined)).toEqual([0, 0, 0, 0, 0, 0, 0, 0])
+  })
+
+  it('should expand a look into the LibRaw approximations', () => {
+    const params = expandLook({ quality: 3, look: { exposure: 1, contrast: 20, saturation: 10 } })
+
+    expect(params.look).toBeUndefined()
+    expect(params.brightness).toBeCloseTo(1.2)
+    expect(params.gamma![0]).toBeCloseTo(2.3)
+    expect(params.gamma![1]).toBeCloseTo(4.1)
+    expect(Object.keys(params).sort()).toEqual(['brightness', 'gamma', 'quality', 'saturation'])
+  })
+
+  it('should keep the parameters of a neutral look', () => {
+    expect(expandLook({ brightness: 1.5, look: { exposure: 0 } })).toEqual({ brightness: 1.5 })
+  })
+})
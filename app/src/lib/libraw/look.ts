@@ -0,0 +1,55 @@
+import type { EditParams, LookParams, ProcessParams } from "@/lib/types"
+
+// The basic adjustments that make up a look, in setLook() argument order
+export const LOOK_KEYS = ["exposure", "contrast", "highlights", "shadows", "whites", "blacks", "saturation", "vibrance"] as const
+
+export function isNeutralLook(look: LookParams | undefined): boolean {
+  return !look || LOOK_KEYS.every(key => !look[key])
+}
+
+// The look of edit, undefined when it changes nothing
+export function editLook(edit: EditParams): LookParams | undefined {
+  const look: LookParams = {}
+  for (const key of LOOK_KEYS) look[key] = edit[key]
+  return isNeutralLook(look) ? undefined : look
+}
+
+// setLook() arguments, all 0 without a look
+export function lookArgs(look: LookParams | undefined): number[] {
+  return LOOK_KEYS.map(key => look?.[key] ?? 0)
+}
+
+// params with the look replaced by its approximation through LibRaw
+// parameters, for builds without setLook(). Exposure and
+// contrast become brightness and gamma, shadows, blacks and whites the
+// exposure shift, user black and auto-bright thresholds.
+export function expandLook({ look, ...params }: ProcessParams): ProcessParams {
+  if (isNeutralLook(look)) return params
+  const { exposure = 0, contrast = 0, highlights = 0, shadows = 0, whites = 0, blacks = 0, saturation = 0, vibrance = 0 } = look!
+
+  const expanded: ProcessParams = { ...params }
+  if (exposure) {
+    expanded.brightness = (params.brightness ?? 1) * (1 + exposure / 5) // -5 to +5 -> 0 to 2
+  }
+  if (contrast) {
+    expanded.gamma = [
+      2.2 + contrast / 200, // Gamma: 1.7 to 2.7
+      4.5 - contrast / 50,  // Toe: 3.5 to 6.5
+    ]
+  }
+  if (shadows || blacks) {
+    expanded.exposure = {
+      shift: shadows / 100, // -1 to 1
+      preserve: highlights < 0 ? 1.0 : 0.0, // Preserve highlights if pulling them down
+    }
+  }
+  if (blacks) {
+    expanded.userBlack = Math.max(0, 128 + blacks * 1.28) // -100 to +100 -> 0 to 256
+  }
+  if (whites) {
+    expanded.autoBright = { enabled: true, threshold: 0.01 + whites / 10000 } // 0.001 to 0.02
+  }
+  if (saturation) expanded.saturation = saturation
+  if (vibrance) expanded.vibrance = vibrance
+  return expanded
+}
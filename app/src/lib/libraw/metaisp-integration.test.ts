@@ -0,0 +1,78 @@
+import { describe, it, expect, vi } from 'vitest';
+import { LibRawMetaISPBridge, MetaISPHeap } from './metaisp-integration';
+
+// Bump allocator over a heap that can grow like WASM memory
+function createHeap(bytes: number) {
+  let next = 16;
+  const heap: MetaISPHeap & { grow(): void } = {
+    HEAPF32: new Float32Array(bytes / 4),
+    _malloc: vi.fn((size: number) => {
+      const ptr = next;
+      next += size;
+      return ptr;
+    }),
+    _free: vi.fn(),
+    grow() {
+      const grown = new Float32Array(heap.HEAPF32.length * 2);
+      grown.set(heap.HEAPF32);
+      heap.HEAPF32 = grown;
+    },
+  };
+  return heap;
+}
+
+// Writes the tile x into every raw element and y into every RGB element
+function createInstance(heap: MetaISPHeap) {
+  return {
+    getMetaISPLayout: () => ({ width: 101, height: 64, cfa: 'GRBG', black: [512, 512, 512, 512], maximum: 16383 }),
+    packMetaISPInputs: vi.fn((rawPtr: number, rgbPtr: number, x: number, y: number, width: number, height: number) => {
+      heap.HEAPF32.fill(x, rawPtr / 4, rawPtr / 4 + width * height);
+      heap.HEAPF32.fill(y, rgbPtr / 4, rgbPtr / 4 + 3 * width * height);
+      return true;
+    }),
+  };
+}
+
+describe('LibRawMetaISPBridge native packing', () => {
+  it('should pack the frame into heap views without copying', () => {
+    const heap = createHeap(1 << 20);
+    const instance = createInstance(heap);
+    const bridge = new LibRawMetaISPBridge(instance, heap);
+
+    expect(bridge.canPackNatively()).toBe(true);
+    const packed = bridge.packInputs()!;
+    expect(packed.width).toBe(100);
+    expect(packed.raw.buffer).toBe(heap.HEAPF32.buffer);
+    expect(packed.raw.length).toBe(100 * 64);
+    expect(packed.raw_full.length).toBe(3 * 100 * 64);
+    expect(instance.packMetaISPInputs).toHaveBeenCalledWith(
+      packed.raw.byteOffset, packed.raw_full.byteOffset, 0, 0, 100, 64, false
+    );
+
+    packed.dispose();
+    expect(heap._free).toHaveBeenCalledTimes(2);
+  });
+
+  it('should hand out fresh views after the heap grew', async () => {
+    const heap = createHeap(1 << 16);
+    const instance = createInstance(heap);
+    const source = new LibRawMetaISPBridge(instance, heap).createTileSource();
+
+    const buffers = source.allocate!(4 * 8 * 8, 3 * 16 * 16);
+    heap.grow();
+    await source.packTile({ x: 32, y: 48, width: 16, height: 16 }, buffers);
+
+    expect(buffers.raw.buffer).toBe(heap.HEAPF32.buffer);
+    expect(buffers.raw[0]).toBe(32);
+    expect(buffers.rawFull[3 * 16 * 16 - 1]).toBe(48);
+
+    source.dispose();
+    expect(heap._free).toHaveBeenCalledTimes(2);
+  });
+
+  it('should fall back to the per-channel getters without the module', () => {
+    const heap = createHeap(1 << 16);
+    const bridge = new LibRawMetaISPBridge(createInstance(heap));
+    expect(bridge.canPackNatively()).toBe(false);
+  });
+});
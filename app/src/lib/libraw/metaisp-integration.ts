@@ -3,6 +3,8 @@
  * Bridges LibRaw and MetaISP for neural RAW processing
  */
 
+import type { MetaISPTile, MetaISPTileBuffers, MetaISPTileSource } from '@/lib/metaisp/tiling';
+
 export interface MetaISPMetadata {
   iso: number;
   exposure: number;
@@ -33,17 +35,90 @@ export interface BilinearRGB {
   data: Float32Array;
 }
 
+/**
+ * What getMetaISPLayout() reports about the unpacked file
+ */
+export interface MetaISPLayout {
+  width: number;
+  height: number;
+  // 2x2 pattern from the top left, e.g. 'GRBG'
+  cfa: string;
+  black: number[];
+  maximum: number;
+}
+
+/**
+ * The parts of the Emscripten module that native packing writes through
+ */
+export interface MetaISPHeap {
+  _malloc(size: number): number;
+  _free(ptr: number): void;
+  HEAPF32: Float32Array;
+}
+
+/**
+ * Full-frame inputs packed on the WASM heap. raw and raw_full are views
+ * over heap memory, valid until dispose().
+ */
+export interface PackedMetaISPInputs {
+  raw: Float32Array;
+  raw_full: Float32Array;
+  width: number;
+  height: number;
+  dispose(): void;
+}
+
+/**
+ * Tile source that packs straight into heap buffers it allocated
+ */
+export interface NativeTileSource extends MetaISPTileSource {
+  dispose(): void;
+}
+
+// A heap allocation of length floats and its current view
+class HeapFloats {
+  readonly ptr: number;
+  private view: Float32Array | null = null;
+  
+  constructor(private readonly heap: MetaISPHeap, private readonly length: number) {
+    this.ptr = heap._malloc(length * 4);
+    if (!this.ptr) {
+      throw new Error(`Failed to allocate ${length * 4} bytes for MetaISP inputs`);
+    }
+  }
+  
+  // Memory growth detaches views of the old heap, so re-create it then
+  current(): Float32Array {
+    if (!this.view || this.view.buffer !== this.heap.HEAPF32.buffer) {
+      this.view = new Float32Array(this.heap.HEAPF32.buffer, this.ptr, this.length);
+    }
+    return this.view;
+  }
+  
+  free() {
+    this.heap._free(this.ptr);
+  }
+}
+
 export class LibRawMetaISPBridge {
   private librawInstance: any;
+  private heap?: MetaISPHeap;
   
-  constructor(librawInstance: any) {
+  /**
+   * heap is the module the instance belongs to; without it, or with an
+   * older build, inputs come from the per-channel getters instead
+   */
+  constructor(librawInstance: any, heap?: MetaISPHeap) {
     this.librawInstance = librawInstance;
+    this.heap = heap;
   }
   
   /**
    * Check if the loaded RAW file is compatible with MetaISP
    */
   async isMetaISPCompatible(): Promise<boolean> {
+    // The native packer handles every 2x2 Bayer phase
+    if (this.getLayout()) return true;
     try {
       const metadata = await this.getMetaISPMetadata();
       return metadata.cfa_pattern === 'RGGB';
@@ -52,6 +127,111 @@ export class LibRawMetaISPBridge {
     }
   }
   
+  /**
+   * CFA and levels of the unpacked file, null for non-Bayer files or
+   * builds without native packing
+   */
+  getLayout(): MetaISPLayout | null {
+    if (typeof this.librawInstance.getMetaISPLayout !== 'function') return null;
+    try {
+      return this.librawInstance.getMetaISPLayout();
+    } catch {
+      return null;
+    }
+  }
+  
+  /**
+   * Whether inputs can be packed natively into heap memory
+   */
+  canPackNatively(): boolean {
+    return !!this.heap && typeof this.librawInstance.packMetaISPInputs === 'function' && this.getLayout() !== null;
+  }
+  
+  /**
+   * Pack the whole frame in one native pass. The arrays are heap views
+   * that tensors wrap without copying.
+   */
+  packInputs(): PackedMetaISPInputs | null {
+    const layout = this.getLayout();
+    if (!this.heap || !layout) return null;
+    
+    const width = layout.width & ~1;
+    const height = layout.height & ~1;
+    const raw = new HeapFloats(this.heap, 4 * (width >> 1) * (height >> 1));
+    let full: HeapFloats;
+    try {
+      full = new HeapFloats(this.heap, 3 * width * height);
+    } catch (error) {
+      raw.free();
+      throw error;
+    }
+    
+    if (!this.librawInstance.packMetaISPInputs(raw.ptr, full.ptr, 0, 0, width, height, false)) {
+      raw.free();
+      full.free();
+      return null;
+    }
+    
+    return {
+      raw: raw.current(),
+      raw_full: full.current(),
+      width,
+      height,
+      dispose: () => {
+        raw.free();
+        full.free();
+      }
+    };
+  }
+  
+  /**
+   * Tile source for MetaISPProcessor.processTiled() that packs each tile
+   * natively, so no full-frame tensor is ever allocated
+   */
+  createTileSource(): NativeTileSource {
+    const heap = this.heap;
+    if (!heap) {
+      throw new Error('Native MetaISP packing needs the LibRaw module');
+    }
+    
+    const allocations = new Map<MetaISPTileBuffers, [HeapFloats, HeapFloats]>();
+    
+    return {
+      allocate: (rawLength: number, fullLength: number) => {
+        const raw = new HeapFloats(heap, rawLength);
+        let full: HeapFloats;
+        try {
+          full = new HeapFloats(heap, fullLength);
+        } catch (error) {
+          raw.free();
+          throw error;
+        }
+        const buffers = { raw: raw.current(), rawFull: full.current() };
+        allocations.set(buffers, [raw, full]);
+        return buffers;
+      },
+      packTile: (tile: MetaISPTile, buffers: MetaISPTileBuffers) => {
+        const allocation = allocations.get(buffers);
+        if (!allocation) {
+          throw new Error('MetaISP tile buffers were not allocated by this source');
+        }
+        const [raw, full] = allocation;
+        if (!this.librawInstance.packMetaISPInputs(raw.ptr, full.ptr, tile.x, tile.y, tile.width, tile.height, false)) {
+          throw new Error(`Failed to pack MetaISP tile at ${tile.x},${tile.y}`);
+        }
+        buffers.raw = raw.current();
+        buffers.rawFull = full.current();
+      },
+      dispose: () => {
+        allocations.forEach(([raw, full]) => {
+          raw.free();
+          full.free();
+        });
+        allocations.clear();
+      }
+    };
+  }
+  
   /**
    * Get Bayer channels for MetaISP (4 channels: R, G1, G2, B)
    */
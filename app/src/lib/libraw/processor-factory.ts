@@ -1,21 +1,47 @@
 import { LibRawProcessor } from "@/lib/types"
 import { LibRawWASM } from "./index"
+import type { LibRawModuleOptions } from "./libraw-loader"
 import { LibRawMock } from "./mock"
+import { LibRawWebGL } from "./webgl-processor"
 
 // Force use real WASM (set to true to use mock for testing)
 const USE_MOCK = false
 
-export async function createProcessor(): Promise<LibRawProcessor> {
+// 'webgl' renders supported parameters on the GPU (see LibRawWebGL),
+// 'auto' does so when WebGL2 is available, 'cpu' always uses LibRaw
+export type ProcessorBackend = "cpu" | "webgl" | "auto"
+
+export interface ProcessorOptions extends LibRawModuleOptions {
+  backend?: ProcessorBackend
+}
+
+export function defaultBackend(): ProcessorBackend {
+  const backend = process.env.NEXT_PUBLIC_LIBRAW_BACKEND
+  return backend === "webgl" || backend === "auto" ? backend : "cpu"
+}
+
+export async function createProcessor(options: ProcessorOptions = {}): Promise<LibRawProcessor> {
   if (USE_MOCK || !globalThis.WebAssembly) {
     console.log("Using LibRaw mock implementation")
     return LibRawMock.create()
   }
   
+  const { backend = defaultBackend(), ...moduleOptions } = options
+  let processor: LibRawWASM
   try {
     console.log("Loading LibRaw WASM module")
-    return await LibRawWASM.create()
+    processor = await LibRawWASM.create(moduleOptions)
   } catch (error) {
     console.error("Failed to load LibRaw WASM, falling back to mock:", error)
     return LibRawMock.create()
   }
-}
\ No newline at end of file
+  
+  if (backend !== "cpu") {
+    const gpu = LibRawWebGL.wrap(processor)
+    if (gpu) return gpu
+    if (backend === "webgl") {
+      console.warn("WebGL2 is not available, using the CPU pipeline")
+    }
+  }
+  return processor
+}
@@ -0,0 +1,41 @@
+import { describe, it, expect } from 'vitest'
+import { selectEvictions, downscaleRGBA, CacheEntry } from './unpacked-cache'
+
+function entry(snapshotBytes: number, lastUsed: number, previewBytes = 0): CacheEntry {
+  return { size: snapshotBytes * 2, snapshotBytes, previewBytes, lastUsed }
+}
+
+describe('Unpacked cache', () => {
+  const entries = { a: entry(50, 3, 10), b: entry(40, 1), c: entry(30, 2) }
+
+  it('should evict least recently used entries until the rest fits', () => {
+    expect(selectEvictions(entries, 130)).toEqual([])
+    expect(selectEvictions(entries, 100)).toEqual(['b'])
+    expect(selectEvictions(entries, 0)).toEqual(['b', 'c', 'a'])
+  })
+
+  it('should never evict the entry just written', () => {
+    expect(selectEvictions(entries, 50, 'b')).toEqual(['c', 'a'])
+  })
+
+  it('should downscale the preview by block means', () => {
+    // 4x4 pixels with values 0, 10, ..., 150 in row-major order
+    const data = new Uint8ClampedArray(64)
+    for (let i = 0; i < 16; i++) data.fill(i * 10, i * 4, i * 4 + 4)
+
+    const small = downscaleRGBA({ data, width: 4, height: 4 }, 2)
+    expect([small.width, small.height]).toEqual([2, 2])
+    expect(Array.from(small.data.filter((_, i) => i % 4 === 0))).toEqual([25, 45, 105, 125])
+
+    // Small images keep their size
+    const same = downscaleRGBA({ data, width: 4, height: 4 }, 8)
+    expect(Array.from(same.data)).toEqual(Array.from(data))
+  })
+
+  it('should keep the aspect ratio with a whole step', () => {
+    const image = { data: new Uint8ClampedArray(5 * 3 * 4).fill(7), width: 5, height: 3 }
+    const small = downscaleRGBA(image, 2)
+    expect([small.width, small.height]).toEqual([1, 1])
+    expect(small.data[0]).toBe(7)
+  })
+})
@@ -0,0 +1,259 @@
+import type { UnpackedSnapshot } from "@/lib/types"
+
+// Persistent cache of unpacked RAW files in the Origin Private File System.
+// Reopening a recent photo restores LibRaw's unpacked state and shows the
+// last render from here, instead of reading, opening and unpacking the
+// file again. Entries are gzip-compressed snapshots plus a JPEG preview,
+// dropped least recently used first once the cache exceeds its size.
+
+const DIRECTORY = "unpacked-cache"
+const INDEX_FILE = "index.json"
+const INDEX_VERSION = 1
+// Headers and EXIF (serial number, capture time) are in the first bytes
+const KEY_HEADER_BYTES = 64 * 1024
+export const DEFAULT_CACHE_BYTES = 2 * 1024 * 1024 * 1024
+// Longest side of the stored preview
+export const PREVIEW_SIZE = 1024
+
+export interface CacheEntry {
+  size: number          // Snapshot bytes before compression
+  snapshotBytes: number // Stored sizes
+  previewBytes: number
+  lastUsed: number
+}
+
+interface CacheIndex {
+  version: number
+  entries: Record<string, CacheEntry>
+}
+
+export interface CachedFile {
+  snapshot: UnpackedSnapshot
+  preview: Blob | null
+}
+
+export interface RGBAImage {
+  data: Uint8ClampedArray
+  width: number
+  height: number
+}
+
+// Content key: SHA-256 of the first 64 KiB plus the file size, so that
+// a renamed or re-imported file still hits. null without WebCrypto.
+export async function unpackedCacheKey(file: Blob): Promise<string | null> {
+  const subtle = globalThis.crypto?.subtle
+  if (!subtle) return null
+
+  const header = await file.slice(0, KEY_HEADER_BYTES).arrayBuffer()
+  const digest = new Uint8Array(await subtle.digest("SHA-256", header))
+  const hex = Array.from(digest.subarray(0, 16), b => b.toString(16).padStart(2, "0")).join("")
+  return `${hex}-${file.size.toString(36)}`
+}
+
+// Least recently used keys to drop so that the rest fits in maxBytes.
+// keep (the entry just written) is never dropped.
+export function selectEvictions(entries: Record<string, CacheEntry>, maxBytes: number, keep?: string): string[] {
+  const bytes = (entry: CacheEntry) => entry.snapshotBytes + entry.previewBytes
+  let total = Object.values(entries).reduce((sum, entry) => sum + bytes(entry), 0)
+
+  const evicted: string[] = []
+  const oldestFirst = Object.keys(entries)
+    .filter(key => key !== keep)
+    .sort((a, b) => entries[a].lastUsed - entries[b].lastUsed)
+  for (const key of oldestFirst) {
+    if (total <= maxBytes) break
+    total -= bytes(entries[key])
+    evicted.push(key)
+  }
+  return evicted
+}
+
+// Copy of image at most maxSide pixels on its longest side, each pixel
+// the mean of the 2x2 samples at the center of its block. Synchronous, so
+// it can run before the image buffer is transferred away.
+export function downscaleRGBA(image: RGBAImage, maxSide = PREVIEW_SIZE): RGBAImage {
+  const step = Math.max(1, Math.ceil(Math.max(image.width, image.height) / maxSide))
+  const width = Math.max(1, Math.floor(image.width / step))
+  const height = Math.max(1, Math.floor(image.height / step))
+  const data = new Uint8ClampedArray(width * height * 4)
+  const src = image.data
+  const half = step >> 1
+  const dx = step > 1 ? 4 : 0
+  const dy = step > 1 ? image.width * 4 : 0
+
+  for (let y = 0; y < height; y++) {
+    for (let x = 0; x < width; x++) {
+      const i = ((y * step + Math.max(0, half - 1)) * image.width + x * step + Math.max(0, half - 1)) * 4
+      const o = (y * width + x) * 4
+      for (let c = 0; c < 4; c++) {
+        data[o + c] = (src[i + c] + src[i + dx + c] + src[i + dy + c] + src[i + dy + dx + c] + 2) >> 2
+      }
+    }
+  }
+  return { data, width, height }
+}
+
+// JPEG of a downscaleRGBA() result, null without OffscreenCanvas
+export async function encodePreview(image: RGBAImage): Promise<Blob | null> {
+  if (typeof OffscreenCanvas === "undefined") return null
+  const canvas = new OffscreenCanvas(image.width, image.height)
+  const context = canvas.getContext("2d")
+  if (!context) return null
+  context.putImageData(new ImageData(image.data, image.width, image.height), 0, 0)
+  return canvas.convertToBlob({ type: "image/jpeg", quality: 0.85 })
+}
+
+// Subset of FileSystemSyncAccessHandle (worker-only, e.g. Safari without createWritable)
+interface SyncAccessHandle {
+  write(buffer: Uint8Array, options: { at: number }): number
+  truncate(size: number): void
+  flush(): void
+  close(): void
+}
+
+async function writeFile(handle: FileSystemFileHandle, stream: ReadableStream<Uint8Array>): Promise<void> {
+  if (typeof handle.createWritable === "function") {
+    await stream.pipeTo(await handle.createWritable())
+    return
+  }
+
+  const access: SyncAccessHandle = await (handle as any).createSyncAccessHandle()
+  const reader = stream.getReader()
+  let offset = 0
+  try {
+    access.truncate(0)
+    for (;;) {
+      const { done, value } = await reader.read()
+      if (done) break
+      offset += access.write(value, { at: offset })
+    }
+    access.flush()
+  } finally {
+    reader.releaseLock()
+    access.close()
+  }
+}
+
+const snapshotName = (key: string) => `${key}.snap.gz`
+const previewName = (key: string) => `${key}.jpg`
+
+// One per worker. Index writes are serialized; concurrent caches in other
+// workers of the same origin may lose each other's lastUsed updates, which
+// only affects eviction order.
+export class UnpackedCache {
+  private indexWrite: Promise<void> = Promise.resolve()
+
+  private constructor(
+    private readonly directory: FileSystemDirectoryHandle,
+    private readonly index: CacheIndex,
+    private readonly maxBytes: number
+  ) {}
+
+  // null when OPFS or compression streams are not available
+  static async open(maxBytes = DEFAULT_CACHE_BYTES): Promise<UnpackedCache | null> {
+    if (typeof navigator === "undefined" || typeof navigator.storage?.getDirectory !== "function" ||
+        typeof CompressionStream === "undefined") {
+      return null
+    }
+
+    try {
+      const root = await navigator.storage.getDirectory()
+      const directory = await root.getDirectoryHandle(DIRECTORY, { create: true })
+      // Stay well inside the origin's quota
+      const { quota } = (await navigator.storage.estimate?.()) ?? {}
+      const limit = quota ? Math.min(maxBytes, quota / 4) : maxBytes
+      return new UnpackedCache(directory, await UnpackedCache.readIndex(directory), limit)
+    } catch (error) {
+      console.warn("Unpacked cache unavailable:", error)
+      return null
+    }
+  }
+
+  private static async readIndex(directory: FileSystemDirectoryHandle): Promise<CacheIndex> {
+    try {
+      const file = await (await directory.getFileHandle(INDEX_FILE)).getFile()
+      const index = JSON.parse(await file.text())
+      if (index?.version === INDEX_VERSION && index.entries) return index
+    } catch {
+      // Missing or unreadable: start over
+    }
+    return { version: INDEX_VERSION, entries: {} }
+  }
+
+  has(key: string): boolean {
+    return key in this.index.entries
+  }
+
+  // Decompressing stream of the snapshot and the preview, null on a miss
+  async get(key: string): Promise<CachedFile | null> {
+    const entry = this.index.entries[key]
+    if (!entry) return null
+
+    try {
+      const file = await (await this.directory.getFileHandle(snapshotName(key))).getFile()
+      const preview = entry.previewBytes
+        ? await (await this.directory.getFileHandle(previewName(key))).getFile()
+        : null
+      entry.lastUsed = Date.now()
+      this.saveIndex()
+      return {
+        snapshot: { size: entry.size, stream: file.stream().pipeThrough(new DecompressionStream("gzip")) },
+        preview,
+      }
+    } catch {
+      await this.delete(key)
+      return null
+    }
+  }
+
+  async put(key: string, snapshot: UnpackedSnapshot): Promise<void> {
+    const handle = await this.directory.getFileHandle(snapshotName(key), { create: true })
+    await writeFile(handle, snapshot.stream.pipeThrough(new CompressionStream("gzip")))
+
+    this.index.entries[key] = {
+      size: snapshot.size,
+      snapshotBytes: (await handle.getFile()).size,
+      previewBytes: this.index.entries[key]?.previewBytes ?? 0,
+      lastUsed: Date.now(),
+    }
+    await this.evict(key)
+  }
+
+  // Replaces the preview of an entry that put() stored
+  async putPreview(key: string, preview: Blob): Promise<void> {
+    if (!this.has(key)) return
+
+    const handle = await this.directory.getFileHandle(previewName(key), { create: true })
+    await writeFile(handle, preview.stream())
+    const entry = this.index.entries[key]
+    if (!entry) return
+    entry.previewBytes = preview.size
+    await this.evict(key)
+  }
+
+  async delete(key: string): Promise<void> {
+    delete this.index.entries[key]
+    await Promise.all([snapshotName(key), previewName(key)].map(name =>
+      this.directory.removeEntry(name).catch(() => undefined)
+    ))
+    await this.saveIndex()
+  }
+
+  private async evict(keep: string): Promise<void> {
+    for (const key of selectEvictions(this.index.entries, this.maxBytes, keep)) {
+      await this.delete(key)
+    }
+    await this.saveIndex()
+  }
+
+  private saveIndex(): Promise<void> {
+    const json = JSON.stringify(this.index)
+    this.indexWrite = this.indexWrite
+      .then(async () => {
+        const handle = await this.directory.getFileHandle(INDEX_FILE, { create: true })
+        await writeFile(handle, new Blob([json]).stream())
+      })
+      .catch(error => console.warn("Failed to write the unpacked cache index:", error))
+    return this.indexWrite
+  }
+}
@@ -0,0 +1,125 @@
+import { describe, it, expect, afterEach, vi } from 'vitest'
+import { selectLibRawVariant, fallbackVariant, isWorkerContext, extractEmbeddedWasm, locateLibRawFile } from './wasm-loader-helper'
+
+describe('selectLibRawVariant', () => {
+  afterEach(() => {
+    vi.unstubAllGlobals()
+  })
+
+  it('should pick the threaded build in an isolated worker', () => {
+    vi.stubGlobal('crossOriginIsolated', true)
+    expect(selectLibRawVariant(true, true)).toBe('threaded')
+  })
+
+  it('should fall back to the SIMD build without isolation', () => {
+    vi.stubGlobal('crossOriginIsolated', false)
+    expect(selectLibRawVariant(true, true)).toBe('simd')
+  })
+
+  it('should fall back when SharedArrayBuffer is unavailable', () => {
+    vi.stubGlobal('crossOriginIsolated', true)
+    vi.stubGlobal('SharedArrayBuffer', undefined)
+    expect(selectLibRawVariant(true, true)).toBe('simd')
+  })
+
+  it('should never use the threaded build on the main thread', () => {
+    vi.stubGlobal('crossOriginIsolated', true)
+    expect(selectLibRawVariant(false, true)).toBe('simd')
+  })
+
+  it('should use the scalar build without SIMD support', () => {
+    vi.stubGlobal('crossOriginIsolated', true)
+    expect(selectLibRawVariant(true, false)).toBe('single')
+  })
+
+  it('should detect the main thread under jsdom', () => {
+    expect(isWorkerContext()).toBe(false)
+  })
+})
+
+describe('fallbackVariant', () => {
+  it('should end at the scalar build', () => {
+    expect(fallbackVariant('simd')).toBe('single')
+    expect(fallbackVariant('single')).toBeNull()
+  })
+})
+
+describe('extractEmbeddedWasm', () => {
+  it('should decode the binary embedded by SINGLE_FILE builds', () => {
+    const script = `var wasmBinaryFile = "data:application/octet-stream;base64,AGFzbQEAAAA=";`
+    expect(Array.from(extractEmbeddedWasm(script)!)).toEqual([0, 97, 115, 109, 1, 0, 0, 0])
+  })
+
+  it('should return null when no binary is embedded', () => {
+    expect(extractEmbeddedWasm(`var wasmBinaryFile = "libraw.wasm";`)).toBeNull()
+  })
+})
+
+describe('compileLibRawWasm', () => {
+  const compiled = {} as WebAssembly.Module
+
+  function wasmResponse(contentType: string) {
+    return {
+      ok: true,
+      status: 200,
+      headers: new Headers({ 'Content-Type': contentType }),
+      arrayBuffer: async () => new Uint8Array([0, 97, 115, 109, 1, 0, 0, 0]).buffer,
+    }
+  }
+
+  // Fresh module for a compile cache of its own
+  async function loadHelper() {
+    vi.resetModules()
+    return import('./wasm-loader-helper')
+  }
+
+  afterEach(() => {
+    vi.unstubAllGlobals()
+    vi.restoreAllMocks()
+  })
+
+  it('should stream-compile the separate binary once per context', async () => {
+    const fetchMock = vi.fn().mockResolvedValue(wasmResponse('application/wasm'))
+    vi.stubGlobal('fetch', fetchMock)
+    const streaming = vi.spyOn(WebAssembly, 'compileStreaming').mockResolvedValue(compiled)
+    const { compileLibRawWasm, compileSeparateWasm } = await loadHelper()
+
+    await expect(compileLibRawWasm('simd')).resolves.toBe(compiled)
+    await expect(compileSeparateWasm('simd')).resolves.toBe(compiled)
+
+    expect(fetchMock).toHaveBeenCalledTimes(1)
+    expect(fetchMock).toHaveBeenCalledWith('/wasm/libraw-simd.wasm')
+    expect(streaming).toHaveBeenCalledTimes(1)
+  })
+
+  it('should compile the bytes when the binary has another content type', async () => {
+    vi.stubGlobal('fetch', vi.fn().mockResolvedValue(wasmResponse('application/octet-stream')))
+    const streaming = vi.spyOn(WebAssembly, 'compileStreaming')
+    const compile = vi.spyOn(WebAssembly, 'compile').mockResolvedValue(compiled)
+    const { compileSeparateWasm } = await loadHelper()
+
+    await expect(compileSeparateWasm('single')).resolves.toBe(compiled)
+    expect(streaming).not.toHaveBeenCalled()
+    expect(compile).toHaveBeenCalledTimes(1)
+  })
+
+  it('should fall back to the binary embedded in a SINGLE_FILE script', async () => {
+    const script = `var wasmBinaryFile = "data:application/octet-stream;base64,AGFzbQEAAAA=";`
+    vi.stubGlobal('fetch', vi.fn()
+      .mockResolvedValueOnce({ ok: false, status: 404, headers: new Headers() })
+      .mockResolvedValueOnce({ ok: true, status: 200, text: async () => script }))
+    const compile = vi.spyOn(WebAssembly, 'compile').mockResolvedValue(compiled)
+    const { compileLibRawWasm, compileSeparateWasm } = await loadHelper()
+
+    await expect(compileLibRawWasm('single')).resolves.toBe(compiled)
+    expect(Array.from(compile.mock.calls[0][0] as Uint8Array)).toEqual([0, 97, 115, 109, 1, 0, 0, 0])
+    await expect(compileSeparateWasm('single')).resolves.toBeNull()
+  })
+})
+
+describe('locateLibRawFile', () => {
+  it('should resolve files next to the build script', () => {
+    const locate = locateLibRawFile('simd')
+    expect(locate('libraw-simd.deferred.wasm')).toBe(`${location.origin}/wasm/libraw-simd.deferred.wasm`)
+  })
+})
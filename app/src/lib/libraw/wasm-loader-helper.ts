@@ -1,50 +1,203 @@
 // Helper to load WASM module in different environments
-export async function loadLibRawWASM() {
-  const isWorker = typeof WorkerGlobalScope !== 'undefined' && (self as any) instanceof WorkerGlobalScope;
-  
+
+// 'threaded' is the -pthread + SIMD build (libraw-mt.js), 'simd' the
+// -msimd128 build (libraw-simd.js), 'single' the scalar libraw.js
+export type LibRawVariant = 'threaded' | 'simd' | 'single';
+
+const WASM_URLS: Record<LibRawVariant, string> = {
+  threaded: '/wasm/libraw-mt.js',
+  simd: '/wasm/libraw-simd.js',
+  single: '/wasm/libraw.js',
+};
+
+// Smallest module using a v128 instruction (i32.const 0, i8x16.splat, i8x16.popcnt)
+const SIMD_PROBE = new Uint8Array([
+  0, 97, 115, 109, 1, 0, 0, 0, 1, 5, 1, 96, 0, 1, 123, 3, 2, 1, 0, 10, 10, 1, 8, 0, 65, 0, 253, 15, 253, 98, 11,
+]);
+
+let simdSupported: boolean | null = null;
+
+export function isSimdSupported(): boolean {
+  if (simdSupported === null) {
+    try {
+      simdSupported = typeof WebAssembly !== 'undefined' && WebAssembly.validate(SIMD_PROBE);
+    } catch {
+      simdSupported = false;
+    }
+  }
+  return simdSupported;
+}
+
+// Next variant to try when one fails to load
+export function fallbackVariant(variant: LibRawVariant): LibRawVariant | null {
+  if (variant === 'threaded') return isSimdSupported() ? 'simd' : 'single';
+  if (variant === 'simd') return 'single';
+  return null;
+}
+
+export function isWorkerContext(): boolean {
+  return typeof WorkerGlobalScope !== 'undefined' && (self as any) instanceof WorkerGlobalScope;
+}
+
+// The threaded build needs SharedArrayBuffer, which browsers only expose to
+// crossOriginIsolated pages (COOP/COEP headers, see next.config.mjs). Its
+// thread joins block, so it is only used off the main thread. Both
+// optimized builds need SIMD128.
+export function selectLibRawVariant(
+  isWorker: boolean = isWorkerContext(),
+  simd: boolean = isSimdSupported()
+): LibRawVariant {
+  if (!simd) return 'single';
+  const isolated = typeof crossOriginIsolated !== 'undefined' && crossOriginIsolated === true;
+  const hasSharedMemory = typeof SharedArrayBuffer !== 'undefined';
+  return isWorker && isolated && hasSharedMemory ? 'threaded' : 'simd';
+}
+
+// Emscripten's locateFile() for the files next to variant's script (its
+// .wasm, the split build's .deferred.wasm). A classic script run from a
+// worker would otherwise resolve them against the worker's own URL.
+export function locateLibRawFile(variant: LibRawVariant): (path: string) => string {
+  const base = `${location.origin}${WASM_URLS[variant]}`;
+  return (path: string) => new URL(path, base).href;
+}
+
+// Binary next to each script; SINGLE_FILE builds have none
+function wasmBinaryUrl(variant: LibRawVariant): string {
+  return WASM_URLS[variant].replace(/\.js$/, '.wasm');
+}
+
+// SINGLE_FILE builds embed the wasm binary in the script as base64
+// ("AGFzbQ" encodes "\0asm")
+const EMBEDDED_WASM = /["'](?:data:application\/octet-stream;base64,)?(AGFzbQ[A-Za-z0-9+/=]*)["']/;
+
+export function extractEmbeddedWasm(scriptText: string): Uint8Array | null {
+  const match = scriptText.match(EMBEDDED_WASM);
+  if (!match) return null;
+  const binary = atob(match[1]);
+  const bytes = new Uint8Array(binary.length);
+  for (let i = 0; i < binary.length; i++) {
+    bytes[i] = binary.charCodeAt(i);
+  }
+  return bytes;
+}
+
+const separateWasm = new Map<LibRawVariant, Promise<WebAssembly.Module | null>>();
+
+// Compiles the separate binary of a build while it downloads, once per
+// context. null when only a SINGLE_FILE build is deployed.
+export function compileSeparateWasm(variant: Exclude<LibRawVariant, 'threaded'>): Promise<WebAssembly.Module | null> {
+  let compiled = separateWasm.get(variant);
+  if (!compiled) {
+    compiled = fetchAndCompile(wasmBinaryUrl(variant));
+    // A failed fetch is retried by the next caller
+    compiled.catch(() => separateWasm.delete(variant));
+    separateWasm.set(variant, compiled);
+  }
+  return compiled;
+}
+
+async function fetchAndCompile(url: string): Promise<WebAssembly.Module | null> {
+  const response = await fetch(url);
+  // Hosts with a catch-all route answer with a page instead of a 404
+  if (response.status === 404 || response.headers.get('Content-Type')?.startsWith('text/html')) return null;
+  if (!response.ok) {
+    throw new Error(`Failed to fetch ${url}: ${response.status}`);
+  }
+  // compileStreaming() rejects other content types
+  const streaming = typeof WebAssembly.compileStreaming === 'function'
+    && response.headers.get('Content-Type')?.startsWith('application/wasm');
+  return streaming ? WebAssembly.compileStreaming(response) : WebAssembly.compile(await response.arrayBuffer());
+}
+
+// Compiles a build's wasm once so that several workers can instantiate it
+// without each compiling their own copy. The threaded build is excluded:
+// its memory is shared with its own pthread pool.
+export async function compileLibRawWasm(variant: Exclude<LibRawVariant, 'threaded'>): Promise<WebAssembly.Module> {
+  const compiled = await compileSeparateWasm(variant);
+  if (compiled) return compiled;
+
+  const response = await fetch(WASM_URLS[variant]);
+  if (!response.ok) {
+    throw new Error(`Failed to fetch ${WASM_URLS[variant]}: ${response.status}`);
+  }
+  const bytes = extractEmbeddedWasm(await response.text());
+  if (!bytes) {
+    throw new Error(`No embedded wasm binary in ${WASM_URLS[variant]}`);
+  }
+  return WebAssembly.compile(bytes);
+}
+
+async function loadThreadedWorker() {
+  const url = `${location.origin}${WASM_URLS.threaded}`;
+
+  // libraw-mt.js is a classic script, so no rewriting is needed. Throws if
+  // the threaded build was not deployed.
+  (self as any).importScripts(url);
+
+  const LibRawFactory = (self as any).LibRawModule;
+  if (!LibRawFactory) {
+    throw new Error('LibRaw module not found after importScripts');
+  }
+
+  // pthread workers load the same script to start the module
+  return (options: Record<string, unknown> = {}) =>
+    LibRawFactory({ mainScriptUrlOrBlob: url, ...options });
+}
+
+export async function loadLibRawWASM(variant: LibRawVariant = 'single') {
+  const isWorker = isWorkerContext();
+
   if (isWorker) {
-    console.log('Loading LibRaw in worker context');
-    
+    console.log(`Loading LibRaw in worker context (${variant})`);
+
+    if (variant === 'threaded') {
+      return loadThreadedWorker();
+    }
+
     // In Worker context, use importScripts
-    const response = await fetch('/wasm/libraw.js');
+    const url = WASM_URLS[variant];
+    const response = await fetch(url);
+    if (!response.ok) {
+      throw new Error(`Failed to fetch ${url}: ${response.status}`);
+    }
     const scriptText = await response.text();
-    
+
     // Remove ES6 export statements and import.meta references
     const modifiedScript = scriptText
       .replace(/export\s+default\s+/g, 'self.LibRawModule = ')
       .replace(/export\s+{[^}]*}/g, '')
-      .replace(/import\.meta\.url/g, `'${location.origin}/wasm/libraw.js'`)
+      .replace(/import\.meta\.url/g, `'${location.origin}${url}'`)
       .replace(/import\.meta/g, '{}');
-    
+
     // Create a blob URL with the modified script
     const blob = new Blob([modifiedScript], { type: 'application/javascript' });
     const blobUrl = URL.createObjectURL(blob);
-    
+
     // Use importScripts to load the module
     (self as any).importScripts(blobUrl);
-    
+
     // Clean up the blob URL
     URL.revokeObjectURL(blobUrl);
-    
+
     // Get the module from global scope
     const LibRawFactory = (self as any).LibRawModule;
     if (!LibRawFactory) {
       throw new Error('LibRaw module not found after importScripts');
     }
-    
+
     return LibRawFactory;
   } else {
     console.log('Loading LibRaw in main thread');
-    
+
     // In main thread, dynamically load the script
     return new Promise((resolve, reject) => {
       const script = document.createElement('script');
-      script.src = '/wasm/libraw.js';
+      script.src = WASM_URLS[variant];
       script.async = true;
-      
+
       // Handle the module when it loads
       (window as any).__librawModuleResolve = resolve;
-      
+
       script.onload = () => {
         // The libraw.js should set a global variable
         const LibRawFactory = (window as any).LibRawModule || (window as any).Module;
@@ -54,12 +207,12 @@ export async function loadLibRawWASM() {
           resolve(LibRawFactory);
         }
       };
-      
+
       script.onerror = () => {
         reject(new Error('Failed to load LibRaw WASM script'));
       };
-      
+
       document.head.appendChild(script);
     });
   }
-}
\ No newline at end of file
+}
@@ -1,34 +1,95 @@
 // Global WASM module loader
 // Loads LibRaw WASM once and caches it for reuse
 
-import { loadLibRawWASM } from './wasm-loader-helper';
+import { loadLibRawWASM, compileSeparateWasm, locateLibRawFile, selectLibRawVariant, fallbackVariant, LibRawVariant } from './wasm-loader-helper';
 
 let wasmModulePromise: Promise<any> | null = null;
+let loadedVariant: LibRawVariant | null = null;
 
-export async function getLibRawModule(): Promise<any> {
+export interface LibRawModuleOptions {
+  // Build to load instead of the one selectLibRawVariant() picks
+  variant?: LibRawVariant;
+  // Precompiled wasm of that build (see compileLibRawWasm), shared by pool workers
+  wasmModule?: WebAssembly.Module;
+}
+
+// Options only apply to the first call; the module is loaded once per context
+export async function getLibRawModule(options: LibRawModuleOptions = {}): Promise<any> {
   if (!wasmModulePromise) {
-    wasmModulePromise = loadWasmModule();
+    wasmModulePromise = loadWasmModule(options);
   }
   return wasmModulePromise;
 }
 
-async function loadWasmModule(): Promise<any> {
-  console.log('Loading LibRaw WASM module...');
-  
+// Variant of the loaded module, null until getLibRawModule() resolves
+export function getLibRawVariant(): LibRawVariant | null {
+  return loadedVariant;
+}
+
+// Compiled module of variant's separate binary, fetched alongside its
+// script; null for SINGLE_FILE and threaded builds, whose runtime loads
+// the binary itself
+async function precompile(variant: LibRawVariant): Promise<WebAssembly.Module | null> {
+  if (variant === 'threaded') return null;
+  try {
+    return await compileSeparateWasm(variant);
+  } catch (error) {
+    console.warn(`Failed to compile the LibRaw ${variant} binary ahead of its script:`, error);
+    return null;
+  }
+}
+
+async function instantiate(variant: LibRawVariant, precompiled?: WebAssembly.Module): Promise<any> {
+  // Load the factory function while the binary compiles
+  const [LibRawFactory, wasmModule] = await Promise.all([
+    loadLibRawWASM(variant),
+    precompiled ?? precompile(variant),
+  ]);
+
+  // Initialize the module, skipping compilation when it was done elsewhere
+  const locateFile = locateLibRawFile(variant);
+  const LibRaw = await LibRawFactory(wasmModule ? {
+    locateFile,
+    instantiateWasm(imports: WebAssembly.Imports, receiveInstance: (instance: WebAssembly.Instance, module: WebAssembly.Module) => void) {
+      WebAssembly.instantiate(wasmModule, imports).then(instance => receiveInstance(instance, wasmModule));
+      return {};
+    },
+  } : { locateFile });
+  loadedVariant = variant;
+  return LibRaw;
+}
+
+async function loadWasmModule(options: LibRawModuleOptions): Promise<any> {
+  const variant = options.variant ?? selectLibRawVariant();
+  console.log(`Loading LibRaw WASM module (${variant})...`);
+
   try {
-    // Load the factory function
-    const LibRawFactory = await loadLibRawWASM();
-    
-    // Initialize the module
-    const LibRaw = await LibRawFactory();
-    
+    let LibRaw;
+    let current: LibRawVariant = variant;
+    for (;;) {
+      try {
+        // The precompiled module only matches the requested variant
+        LibRaw = await instantiate(current, current === variant ? options.wasmModule : undefined);
+        break;
+      } catch (error) {
+        // Optional build not deployed, or its threads failed to start
+        const next = fallbackVariant(current);
+        if (!next) throw error;
+        console.warn(`LibRaw ${current} build unavailable, falling back to ${next}:`, error);
+        current = next;
+      }
+    }
+
     console.log('LibRaw WASM module loaded successfully');
     console.log('Version:', LibRaw.LibRaw.getVersion());
     console.log('Supported cameras:', LibRaw.LibRaw.getCameraCount());
-    
+    if (typeof LibRaw.LibRaw.getMaxThreads === 'function') {
+      console.log('Demosaic threads:', LibRaw.LibRaw.getMaxThreads());
+    }
+
     return LibRaw;
   } catch (error) {
     console.error('Failed to load LibRaw WASM module:', error);
     throw error;
   }
-}
\ No newline at end of file
+}
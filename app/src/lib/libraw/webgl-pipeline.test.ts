@@ -0,0 +1,99 @@
+import { describe, it, expect } from 'vitest'
+import type { ColorPipelineInput } from '@/lib/types'
+import {
+  supportsGPURender,
+  gammaCurve,
+  cfaColors,
+  whiteBalance,
+  sampleBlocks,
+  autoWhiteLevel,
+  pipelineUniforms,
+} from './webgl-pipeline'
+
+const IDENTITY = [1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0]
+
+function makeInput(overrides: Partial<ColorPipelineInput> = {}): ColorPipelineInput {
+  return {
+    width: 4,
+    height: 2,
+    cfa: 'RGGB',
+    data: new Uint16Array(8),
+    camMul: [2, 1, 1.5, 1],
+    preMul: [1.8, 1, 1.2, 1],
+    rgbCam: IDENTITY,
+    flip: 0,
+    ...overrides,
+  }
+}
+
+describe('WebGL pipeline parameters', () => {
+  it('should leave CPU-only parameters to LibRaw', () => {
+    expect(supportsGPURender({})).toBe(true)
+    expect(supportsGPURender({ quality: 3, halfSize: true, useCameraWB: true, userFlip: 6 })).toBe(true)
+    expect(supportsGPURender({ highlight: 2 })).toBe(false)
+    expect(supportsGPURender({ outputColor: 2 })).toBe(false)
+    expect(supportsGPURender({ outputBPS: 16 })).toBe(false)
+    expect(supportsGPURender({ useAutoWB: true })).toBe(false)
+    expect(supportsGPURender({ cropArea: { x1: 0, y1: 0, x2: 10, y2: 10 } })).toBe(false)
+    expect(supportsGPURender({ look: { contrast: 20 } })).toBe(false)
+    expect(supportsGPURender({ look: { exposure: 0 } })).toBe(true)
+  })
+
+  it('should solve the gamma curve like dcraw', () => {
+    // BT.709: linear below 0.018, offset 0.099
+    const g = gammaCurve(0.45, 4.5)
+    expect(g[3]).toBeCloseTo(0.018054, 5)
+    expect(g[4]).toBeCloseTo(0.099297, 5)
+    // sRGB
+    expect(gammaCurve(1 / 2.4, 12.92)[4]).toBeCloseTo(0.055, 3)
+  })
+
+  it('should map the CFA pattern to color indices', () => {
+    expect(cfaColors('RGGB')).toEqual([0, 1, 1, 2])
+    expect(cfaColors('GBRG')).toEqual([1, 2, 0, 1])
+  })
+
+  it('should normalize white balance to the smallest multiplier', () => {
+    const input = makeInput()
+    expect(whiteBalance(input, {})).toEqual([2, 1, 1.5])
+    expect(whiteBalance(input, { useCameraWB: false })).toEqual([1.8, 1, 1.2])
+    expect(whiteBalance(input, { customWB: { r: 1, g1: 2, g2: 2, b: 4 } })).toEqual([1, 2, 4])
+    // Files without as shot multipliers use daylight
+    expect(whiteBalance(makeInput({ camMul: [0, 0, 0, 0] }), {})).toEqual([1.8, 1, 1.2])
+  })
+
+  it('should sample 2x2 blocks with averaged greens', () => {
+    const input = makeInput({ width: 2, height: 2, data: new Uint16Array([65535, 100, 300, 0]) })
+    const samples = sampleBlocks(input)
+    expect(samples).toHaveLength(3)
+    expect(samples[0]).toBeCloseTo(1)
+    expect(samples[1]).toBeCloseTo(200 / 65535)
+    expect(samples[2]).toBe(0)
+  })
+
+  it('should find the auto brightness white point', () => {
+    const samples = new Float32Array(300).fill(0.5)
+    expect(autoWhiteLevel(samples, [1, 1, 1], IDENTITY, 1, 0.01)).toBe(0.5)
+    // Exposure moves the white point with the data
+    expect(autoWhiteLevel(samples, [1, 1, 1], IDENTITY, 1.5, 0.01)).toBe(0.75)
+    expect(autoWhiteLevel(new Float32Array(0), [1, 1, 1], IDENTITY, 1, 0.01)).toBe(1)
+  })
+
+  it('should size the output after half size and flip', () => {
+    const input = makeInput({ rgbCam: [1, 2, 3, 0, 4, 5, 6, 0, 7, 8, 9, 0] })
+    const samples = new Float32Array(3).fill(0.5)
+
+    const full = pipelineUniforms(input, samples, { noAutoBright: true, brightness: 2 })
+    expect([full.width, full.height]).toEqual([4, 2])
+    expect(full.scale).toBe(2)
+    // Column-major for uniformMatrix3fv
+    expect(full.matrix).toEqual([1, 4, 7, 2, 5, 8, 3, 6, 9])
+
+    const rotated = pipelineUniforms(input, samples, { halfSize: true, userFlip: 6, noAutoBright: true })
+    expect([rotated.width, rotated.height]).toEqual([1, 2])
+    expect(rotated.flip).toBe(6)
+
+    // The file's own orientation applies without userFlip
+    expect(pipelineUniforms(makeInput({ flip: 5 }), samples, {}).width).toBe(2)
+  })
+})
@@ -0,0 +1,430 @@
+import type { ColorPipelineInput, ProcessParams } from "@/lib/types"
+import { isNeutralLook } from "./look"
+
+// WebGL2 rendering of unpacked Bayer data: Malvar-He-Cutler demosaic,
+// white balance, camera to sRGB matrix, brightness and dcraw's gamma curve
+// in one fragment shader. The arithmetic follows dcraw_process() with
+// highlight clipping so that both backends give close results.
+
+// Parameters only the CPU pipeline implements
+export function supportsGPURender(params: ProcessParams): boolean {
+  return (params.outputColor ?? 1) === 1 &&
+    !params.useAutoWB &&
+    !params.highlight &&
+    !params.noiseThreshold &&
+    !params.medianPasses &&
+    !params.fourColorRGB &&
+    !params.dcbIterations &&
+    !params.dcbEnhance &&
+    (params.outputBPS ?? 8) === 8 &&
+    params.userBlack === undefined &&
+    !params.aberrationCorrection &&
+    !params.shotSelect &&
+    !params.cropArea &&
+    !params.greyBox &&
+    !params.outputTiff &&
+    !params.clipMasks &&
+    isNeutralLook(params.look)
+}
+
+// dcraw's gamma_curve() constants: linear below g[3] with slope g[1] (ts),
+// pow(x, g[0]) * (1 + g[4]) - g[4] above; g[2] scales the log curve of pwr 0
+export function gammaCurve(pwr: number, ts: number): number[] {
+  const g = [pwr, ts, 0, 0, 0]
+  const bnd = [0, 0]
+  bnd[ts >= 1 ? 1 : 0] = 1
+  if (ts && (ts - 1) * (pwr - 1) <= 0) {
+    for (let i = 0; i < 48; i++) {
+      g[2] = (bnd[0] + bnd[1]) / 2
+      if (pwr) bnd[(Math.pow(g[2] / ts, -pwr) - 1) / pwr - 1 / g[2] > -1 ? 1 : 0] = g[2]
+      else bnd[g[2] / Math.exp(1 - 1 / g[2]) < ts ? 1 : 0] = g[2]
+    }
+    g[3] = g[2] / ts
+    if (pwr) g[4] = g[2] * (1 / pwr - 1)
+  }
+  return g
+}
+
+const CFA_COLORS: Record<string, number> = { R: 0, G: 1, B: 2 }
+
+// Color index per pattern position (0,0), (0,1), (1,0), (1,1)
+export function cfaColors(cfa: string): number[] {
+  return Array.from(cfa.slice(0, 4), c => CFA_COLORS[c] ?? 1)
+}
+
+// What the shader needs besides the Bayer texture
+export type ColorMetadata = Omit<ColorPipelineInput, "data">
+
+// R, G, B multipliers normalized like scale_colors() without highlight
+// recovery: the smallest is 1, so every channel clips at the same level
+export function whiteBalance(input: ColorMetadata, params: ProcessParams): number[] {
+  let mul = input.preMul
+  if (params.customWB) {
+    mul = [params.customWB.r, (params.customWB.g1 + params.customWB.g2) / 2, params.customWB.b]
+  } else if ((params.useCameraWB ?? true) && input.camMul[0] > 0) {
+    mul = input.camMul
+  }
+  const rgb = [mul[0], mul[1], mul[2]].map(m => (m > 0 ? m : 1))
+  const min = Math.min(...rgb)
+  return rgb.map(m => m / min)
+}
+
+// Camera RGB of at most maxSamples 2x2 blocks (greens averaged), for the
+// auto-brightness histogram. Taken once per file while data is readable.
+export function sampleBlocks(input: ColorPipelineInput, maxSamples = 65536): Float32Array {
+  const blocksX = input.width >> 1
+  const blocksY = input.height >> 1
+  const step = Math.max(1, Math.ceil(Math.sqrt((blocksX * blocksY) / maxSamples)))
+  const colors = cfaColors(input.cfa)
+  const samples: number[] = []
+  const sum = [0, 0, 0]
+  for (let by = 0; by < blocksY; by += step) {
+    for (let bx = 0; bx < blocksX; bx += step) {
+      sum.fill(0)
+      for (let i = 0; i < 4; i++) {
+        const row = by * 2 + (i >> 1)
+        const col = bx * 2 + (i & 1)
+        sum[colors[i]] += input.data[row * input.width + col]
+      }
+      samples.push(sum[0] / 65535, sum[1] / 131070, sum[2] / 65535)
+    }
+  }
+  return new Float32Array(samples)
+}
+
+const HISTOGRAM_BINS = 8192
+
+// White point of write_ppm_tiff(): per channel, the level that threshold
+// of the pixels exceed after white balance and matrix; 1 is full scale
+export function autoWhiteLevel(
+  samples: Float32Array,
+  mul: number[],
+  rgbCam: number[],
+  exposure: number,
+  threshold: number
+): number {
+  const count = samples.length / 3
+  if (count === 0) return 1
+  const histogram = new Uint32Array(3 * HISTOGRAM_BINS)
+  const cam = [0, 0, 0]
+  for (let i = 0; i < count; i++) {
+    for (let c = 0; c < 3; c++) {
+      cam[c] = Math.min(samples[i * 3 + c] * exposure * mul[c], 1)
+    }
+    for (let c = 0; c < 3; c++) {
+      const value = rgbCam[c * 4] * cam[0] + rgbCam[c * 4 + 1] * cam[1] + rgbCam[c * 4 + 2] * cam[2]
+      const bin = Math.min(HISTOGRAM_BINS - 1, Math.max(0, Math.floor(value * HISTOGRAM_BINS)))
+      histogram[c * HISTOGRAM_BINS + bin]++
+    }
+  }
+
+  const perc = count * threshold
+  let white = 0
+  for (let c = 0; c < 3; c++) {
+    let value = HISTOGRAM_BINS
+    let total = 0
+    while (--value > 32) {
+      if ((total += histogram[c * HISTOGRAM_BINS + value]) > perc) break
+    }
+    white = Math.max(white, value)
+  }
+  return white / HISTOGRAM_BINS
+}
+
+export interface PipelineUniforms {
+  width: number       // Output size after half size and flip
+  height: number
+  halfSize: boolean
+  flip: number
+  mul: number[]
+  matrix: number[]    // Column-major mat3 for uniformMatrix3fv
+  exposure: number
+  scale: number       // brightness / white point
+  gamma: number[]     // gammaCurve() constants
+  saturation: number  // 1 leaves colors as they are
+  vibrance: number
+}
+
+export function pipelineUniforms(
+  input: ColorMetadata,
+  samples: Float32Array,
+  params: ProcessParams
+): PipelineUniforms {
+  const halfSize = !!params.halfSize
+  const flip = params.userFlip !== undefined && params.userFlip >= 0 ? params.userFlip : input.flip
+  const imageWidth = halfSize ? input.width >> 1 : input.width
+  const imageHeight = halfSize ? input.height >> 1 : input.height
+  const mul = whiteBalance(input, params)
+  // LibRaw's exp_bef() range
+  const exposure = params.exposure ? Math.min(8, Math.max(0.25, params.exposure.shift)) : 1
+
+  const autoBright = params.autoBright?.enabled ?? !params.noAutoBright
+  const white = autoBright
+    ? autoWhiteLevel(samples, mul, input.rgbCam, exposure, params.autoBright?.threshold || 0.01)
+    : 1
+
+  const matrix: number[] = []
+  for (let col = 0; col < 3; col++) {
+    for (let row = 0; row < 3; row++) matrix.push(input.rgbCam[row * 4 + col])
+  }
+
+  // ProcessParams.gamma is [gamma, toe] as in dcraw -g; LibRaw's default is sRGB
+  const [power, toe] = params.gamma ? [1 / params.gamma[0], params.gamma[1]] : [1 / 2.4, 12.92]
+
+  return {
+    width: flip & 4 ? imageHeight : imageWidth,
+    height: flip & 4 ? imageWidth : imageHeight,
+    halfSize,
+    flip,
+    mul,
+    matrix,
+    exposure,
+    scale: (params.brightness ?? 1) / white,
+    gamma: gammaCurve(power, toe),
+    saturation: 1 + (params.saturation ?? 0) / 100,
+    vibrance: (params.vibrance ?? 0) / 100,
+  }
+}
+
+const VERTEX_SHADER = `#version 300 es
+void main() {
+  // One triangle covering the viewport
+  vec2 p = vec2(float((gl_VertexID << 1) & 2), float(gl_VertexID & 2));
+  gl_Position = vec4(p * 2.0 - 1.0, 0.0, 1.0);
+}`
+
+const FRAGMENT_SHADER = `#version 300 es
+precision highp float;
+precision highp int;
+precision highp usampler2D;
+
+uniform usampler2D u_raw;
+uniform ivec2 u_size;
+uniform ivec4 u_cfa;
+uniform ivec2 u_image;
+uniform int u_flip;
+uniform bool u_half;
+uniform vec3 u_mul;
+uniform mat3 u_matrix;
+uniform float u_exposure;
+uniform float u_scale;
+uniform float u_gamma[5];
+uniform float u_saturation;
+uniform float u_vibrance;
+out vec4 color;
+
+// Mirrored at the edges, which keeps the CFA phase
+float raw(ivec2 p) {
+  p = abs(p);
+  p = min(p, 2 * (u_size - 1) - p);
+  return float(texelFetch(u_raw, p, 0).r) / 65535.0;
+}
+
+int colorAt(ivec2 p) {
+  return u_cfa[(p.y & 1) * 2 + (p.x & 1)];
+}
+
+vec3 demosaic(ivec2 p) {
+  float c = raw(p);
+  float n = raw(p + ivec2(0, -1)), s = raw(p + ivec2(0, 1));
+  float w = raw(p + ivec2(-1, 0)), e = raw(p + ivec2(1, 0));
+  float n2 = raw(p + ivec2(0, -2)), s2 = raw(p + ivec2(0, 2));
+  float w2 = raw(p + ivec2(-2, 0)), e2 = raw(p + ivec2(2, 0));
+  float diag = raw(p + ivec2(-1, -1)) + raw(p + ivec2(1, -1)) + raw(p + ivec2(-1, 1)) + raw(p + ivec2(1, 1));
+
+  int here = colorAt(p);
+  if (here == 1) {
+    // Color of the row neighbours, then of the column neighbours
+    float h = (5.0 * c + 4.0 * (w + e) - (w2 + e2) - diag + 0.5 * (n2 + s2)) / 8.0;
+    float v = (5.0 * c + 4.0 * (n + s) - (n2 + s2) - diag + 0.5 * (w2 + e2)) / 8.0;
+    return colorAt(p + ivec2(1, 0)) == 0 ? vec3(h, c, v) : vec3(v, c, h);
+  }
+  float far = n2 + s2 + w2 + e2;
+  float g = (4.0 * c + 2.0 * (n + s + w + e) - far) / 8.0;
+  float opposite = (6.0 * c + 2.0 * diag - 1.5 * far) / 8.0;
+  return here == 0 ? vec3(c, g, opposite) : vec3(opposite, g, c);
+}
+
+// half_size: one pixel per 2x2 block, greens averaged
+vec3 block(ivec2 p) {
+  vec3 sum = vec3(0.0);
+  for (int i = 0; i < 4; i++) {
+    sum[u_cfa[i]] += raw(p + ivec2(i & 1, i >> 1));
+  }
+  return sum * vec3(1.0, 0.5, 1.0);
+}
+
+float curve(float x) {
+  if (x >= 1.0) return 1.0;
+  if (x < u_gamma[3]) return x * u_gamma[1];
+  if (u_gamma[0] > 0.0) return pow(x, u_gamma[0]) * (1.0 + u_gamma[4]) - u_gamma[4];
+  return log(x) * u_gamma[2] + 1.0;
+}
+
+void main() {
+  // flip_index(): output position to image position
+  ivec2 q = ivec2(gl_FragCoord.xy);
+  if ((u_flip & 4) != 0) q = q.yx;
+  if ((u_flip & 2) != 0) q.y = u_image.y - 1 - q.y;
+  if ((u_flip & 1) != 0) q.x = u_image.x - 1 - q.x;
+
+  vec3 cam = u_half ? block(q * 2) : demosaic(q);
+  cam = min(max(cam, 0.0) * u_exposure * u_mul, 1.0);
+  vec3 rgb = clamp(u_matrix * cam * u_scale, 0.0, 1.0);
+
+  float luma = dot(rgb, vec3(0.2126, 0.7152, 0.0722));
+  float chroma = max(rgb.r, max(rgb.g, rgb.b)) - min(rgb.r, min(rgb.g, rgb.b));
+  rgb = mix(vec3(luma), rgb, u_saturation + u_vibrance * (1.0 - chroma));
+  rgb = clamp(rgb, 0.0, 1.0);
+
+  color = vec4(curve(rgb.r), curve(rgb.g), curve(rgb.b), 1.0);
+}`
+
+function compile(gl: WebGL2RenderingContext, type: number, source: string): WebGLShader {
+  const shader = gl.createShader(type)!
+  gl.shaderSource(shader, source)
+  gl.compileShader(shader)
+  if (!gl.getShaderParameter(shader, gl.COMPILE_STATUS)) {
+    const log = gl.getShaderInfoLog(shader)
+    gl.deleteShader(shader)
+    throw new Error(`Failed to compile shader: ${log}`)
+  }
+  return shader
+}
+
+// Renders into a framebuffer of an OffscreenCanvas, so it works in workers.
+// The Bayer data stays in a texture between renders of the same file.
+export class WebGLPipeline {
+  private readonly uniforms = new Map<string, WebGLUniformLocation | null>()
+  private rawTexture: WebGLTexture | null = null
+  private rawSize: [number, number] = [0, 0]
+  private target: WebGLTexture | null = null
+  private targetSize: [number, number] = [0, 0]
+  private readonly framebuffer: WebGLFramebuffer
+
+  private constructor(
+    private readonly gl: WebGL2RenderingContext,
+    private readonly program: WebGLProgram
+  ) {
+    this.framebuffer = gl.createFramebuffer()!
+  }
+
+  // null without WebGL2 (or without an OffscreenCanvas to get it from)
+  static create(): WebGLPipeline | null {
+    if (typeof OffscreenCanvas === "undefined") return null
+    const gl = new OffscreenCanvas(1, 1).getContext("webgl2", { antialias: false, depth: false })
+    if (!gl) return null
+
+    const program = gl.createProgram()!
+    gl.attachShader(program, compile(gl, gl.VERTEX_SHADER, VERTEX_SHADER))
+    gl.attachShader(program, compile(gl, gl.FRAGMENT_SHADER, FRAGMENT_SHADER))
+    gl.linkProgram(program)
+    if (!gl.getProgramParameter(program, gl.LINK_STATUS)) {
+      throw new Error(`Failed to link shader program: ${gl.getProgramInfoLog(program)}`)
+    }
+    return new WebGLPipeline(gl, program)
+  }
+
+  // Largest width or height upload() and render() accept
+  get maxSize(): number {
+    return this.gl.getParameter(this.gl.MAX_TEXTURE_SIZE)
+  }
+
+  get hasData(): boolean {
+    return this.rawTexture !== null
+  }
+
+  // Copies the Bayer data into a texture; input.data may be released after
+  upload(input: ColorPipelineInput): void {
+    const gl = this.gl
+    this.release()
+    // WebGL rejects views of a SharedArrayBuffer (threaded builds) in some browsers
+    const data = typeof SharedArrayBuffer !== "undefined" && input.data.buffer instanceof SharedArrayBuffer
+      ? input.data.slice()
+      : input.data
+
+    this.rawTexture = gl.createTexture()
+    gl.bindTexture(gl.TEXTURE_2D, this.rawTexture)
+    gl.texParameteri(gl.TEXTURE_2D, gl.TEXTURE_MIN_FILTER, gl.NEAREST)
+    gl.texParameteri(gl.TEXTURE_2D, gl.TEXTURE_MAG_FILTER, gl.NEAREST)
+    gl.pixelStorei(gl.UNPACK_ALIGNMENT, 2)
+    gl.texImage2D(gl.TEXTURE_2D, 0, gl.R16UI, input.width, input.height, 0, gl.RED_INTEGER, gl.UNSIGNED_SHORT, data)
+    this.rawSize = [input.width, input.height]
+
+    gl.useProgram(this.program)
+    const colors = cfaColors(input.cfa)
+    gl.uniform4i(this.location("u_cfa"), colors[0], colors[1], colors[2], colors[3])
+    gl.uniform2i(this.location("u_size"), input.width, input.height)
+  }
+
+  render(u: PipelineUniforms): Uint8ClampedArray {
+    const gl = this.gl
+    if (!this.rawTexture) {
+      throw new Error("No Bayer data uploaded")
+    }
+    this.ensureTarget(u.width, u.height)
+
+    gl.useProgram(this.program)
+    gl.activeTexture(gl.TEXTURE0)
+    gl.bindTexture(gl.TEXTURE_2D, this.rawTexture)
+    gl.uniform1i(this.location("u_raw"), 0)
+    const [width, height] = this.rawSize
+    gl.uniform2i(this.location("u_image"), u.halfSize ? width >> 1 : width, u.halfSize ? height >> 1 : height)
+    gl.uniform1i(this.location("u_flip"), u.flip)
+    gl.uniform1i(this.location("u_half"), u.halfSize ? 1 : 0)
+    gl.uniform3fv(this.location("u_mul"), u.mul)
+    gl.uniformMatrix3fv(this.location("u_matrix"), false, u.matrix)
+    gl.uniform1f(this.location("u_exposure"), u.exposure)
+    gl.uniform1f(this.location("u_scale"), u.scale)
+    gl.uniform1fv(this.location("u_gamma"), u.gamma)
+    gl.uniform1f(this.location("u_saturation"), u.saturation)
+    gl.uniform1f(this.location("u_vibrance"), u.vibrance)
+
+    gl.bindFramebuffer(gl.FRAMEBUFFER, this.framebuffer)
+    gl.viewport(0, 0, u.width, u.height)
+    gl.drawArrays(gl.TRIANGLES, 0, 3)
+
+    // Row y of the framebuffer is output row y, so this is top-down already
+    const pixels = new Uint8ClampedArray(u.width * u.height * 4)
+    gl.readPixels(0, 0, u.width, u.height, gl.RGBA, gl.UNSIGNED_BYTE, pixels)
+    gl.bindFramebuffer(gl.FRAMEBUFFER, null)
+    return pixels
+  }
+
+  // Drops the Bayer texture of the current file
+  release(): void {
+    if (this.rawTexture) {
+      this.gl.deleteTexture(this.rawTexture)
+      this.rawTexture = null
+    }
+  }
+
+  dispose(): void {
+    this.release()
+    if (this.target) this.gl.deleteTexture(this.target)
+    this.target = null
+    this.gl.deleteFramebuffer(this.framebuffer)
+    this.gl.deleteProgram(this.program)
+  }
+
+  private ensureTarget(width: number, height: number): void {
+    const gl = this.gl
+    if (this.target && this.targetSize[0] === width && this.targetSize[1] === height) return
+
+    if (this.target) gl.deleteTexture(this.target)
+    this.target = gl.createTexture()
+    gl.bindTexture(gl.TEXTURE_2D, this.target)
+    gl.texStorage2D(gl.TEXTURE_2D, 1, gl.RGBA8, width, height)
+    gl.bindFramebuffer(gl.FRAMEBUFFER, this.framebuffer)
+    gl.framebufferTexture2D(gl.FRAMEBUFFER, gl.COLOR_ATTACHMENT0, gl.TEXTURE_2D, this.target, 0)
+    gl.bindFramebuffer(gl.FRAMEBUFFER, null)
+    this.targetSize = [width, height]
+  }
+
+  private location(name: string): WebGLUniformLocation | null {
+    if (!this.uniforms.has(name)) {
+      this.uniforms.set(name, this.gl.getUniformLocation(this.program, name))
+    }
+    return this.uniforms.get(name)!
+  }
+}
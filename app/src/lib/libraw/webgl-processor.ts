@@ -0,0 +1,186 @@
+import {
+  LibRawProcessor,
+  ProcessParams,
+  ProcessedImage,
+  EncodeOptions,
+  EncodedImage,
+  PhotoMetadata,
+  ThumbnailData,
+  ExtractedThumbnail,
+  ChannelData,
+  BayerData,
+  MemoryStats,
+  RenderOptions,
+  LinearFormat,
+  LinearImage,
+  ImageRegion,
+  TensorConversionOptions,
+  UnpackedSnapshot,
+} from "@/lib/types"
+import type { LibRawWASM } from "./index"
+import { WebGLPipeline, ColorMetadata, pipelineUniforms, sampleBlocks, supportsGPURender } from "./webgl-pipeline"
+
+// GPU backend: LibRaw opens and unpacks, WebGL2 demosaics and converts
+// colors. Parameters the shader does not cover, region renders and
+// non-Bayer files go to the wrapped CPU processor.
+export class LibRawWebGL implements LibRawProcessor {
+  // Color metadata of the current file; its data moved to the GPU
+  private input: ColorMetadata | null = null
+  private samples = new Float32Array(0)
+  // False once the file turned out to have no GPU input (e.g. X-Trans)
+  private gpuCapable = true
+
+  private constructor(
+    private readonly cpu: LibRawWASM,
+    private readonly pipeline: WebGLPipeline
+  ) {}
+
+  // null when WebGL2 is unavailable in this context
+  static wrap(cpu: LibRawWASM): LibRawWebGL | null {
+    try {
+      const pipeline = WebGLPipeline.create()
+      return pipeline ? new LibRawWebGL(cpu, pipeline) : null
+    } catch (error) {
+      console.warn("WebGL2 pipeline unavailable:", error)
+      return null
+    }
+  }
+
+  async loadFile(buffer: ArrayBuffer): Promise<void> {
+    this.resetInput()
+    await this.cpu.loadFile(buffer)
+  }
+
+  async loadBlob(file: Blob): Promise<void> {
+    this.resetInput()
+    await this.cpu.loadBlob(file)
+  }
+
+  async loadUnpackedSnapshot(snapshot: UnpackedSnapshot): Promise<boolean> {
+    this.resetInput()
+    return this.cpu.loadUnpackedSnapshot(snapshot)
+  }
+
+  createUnpackedSnapshot(): UnpackedSnapshot | null {
+    return this.cpu.createUnpackedSnapshot()
+  }
+
+  async process(params: ProcessParams, options: RenderOptions = {}): Promise<ProcessedImage> {
+    if (!supportsGPURender(params) || !this.ensureInput()) {
+      return this.cpu.process(params, options)
+    }
+    if (options.isCancelled?.()) {
+      throw new DOMException("Render cancelled", "AbortError")
+    }
+
+    const uniforms = pipelineUniforms(this.input!, this.samples, params)
+    const data = this.pipeline.render(uniforms)
+    return {
+      data,
+      width: uniforms.width,
+      height: uniforms.height,
+      metadata: this.cpu.getMetadata(),
+    }
+  }
+
+  processRegion(
+    params: ProcessParams,
+    region: ImageRegion,
+    scale: number,
+    options?: RenderOptions
+  ): Promise<{ image: ProcessedImage; region: ImageRegion }> {
+    return this.cpu.processRegion(params, region, scale, options)
+  }
+
+  processLinear(params: ProcessParams, format?: LinearFormat, options?: RenderOptions): Promise<LinearImage | null> {
+    return this.cpu.processLinear(params, format, options)
+  }
+
+  // Exports need LibRaw's own output at full bit depth
+  encode(params: ProcessParams, options: EncodeOptions, renderOptions?: RenderOptions): Promise<EncodedImage | null> {
+    return this.cpu.encode(params, options, renderOptions)
+  }
+
+  // A GPU render costs about as much as reusing the CPU demosaic, so
+  // progressive previews are skipped for it as well
+  canReuseDemosaic(params: ProcessParams): boolean {
+    if (supportsGPURender(params) && this.ensureInput()) return true
+    return this.cpu.canReuseDemosaic(params)
+  }
+
+  // Binning is one pass over the raw data, cheaper than uploading it
+  renderBinnedPreview(params: ProcessParams, maxSide?: number, options?: RenderOptions): Promise<ProcessedImage | null> {
+    return this.cpu.renderBinnedPreview(params, maxSide, options)
+  }
+
+  getMetadata(): PhotoMetadata {
+    return this.cpu.getMetadata()
+  }
+
+  getThumbnail(): ThumbnailData | null {
+    return this.cpu.getThumbnail()
+  }
+
+  extractThumbnail(file: Blob, options?: { minSize?: number }): Promise<ExtractedThumbnail> {
+    return this.cpu.extractThumbnail(file, options)
+  }
+
+  get4ChannelData(): ChannelData | null {
+    return this.cpu.get4ChannelData()
+  }
+
+  getRawBayerData(): BayerData | null {
+    return this.cpu.getRawBayerData()
+  }
+
+  getHeapSize(): number | null {
+    return this.cpu.getHeapSize()
+  }
+
+  getMemoryStats(): MemoryStats | null {
+    return this.cpu.getMemoryStats()
+  }
+
+  convertTensor(
+    tensor: Float32Array,
+    srcWidth: number,
+    srcHeight: number,
+    options: TensorConversionOptions
+  ): { data: Uint8ClampedArray; width: number; height: number } | null {
+    return this.cpu.convertTensor(tensor, srcWidth, srcHeight, options)
+  }
+
+  dispose(): void {
+    this.resetInput()
+    this.pipeline.dispose()
+    this.cpu.dispose()
+  }
+
+  // Uploads the Bayer data of the current file on first use
+  private ensureInput(): boolean {
+    if (this.input) return true
+    if (!this.gpuCapable) return false
+
+    const input = this.cpu.getColorPipelineInput()
+    const maxSize = this.pipeline.maxSize
+    if (!input || input.width > maxSize || input.height > maxSize) {
+      this.gpuCapable = false
+      return false
+    }
+
+    this.samples = sampleBlocks(input)
+    this.pipeline.upload(input)
+    const { width, height, cfa, camMul, preMul, rgbCam, flip } = input
+    this.input = { width, height, cfa, camMul, preMul, rgbCam, flip }
+    // The texture holds the data now
+    this.cpu.releaseImageData()
+    return true
+  }
+
+  private resetInput(): void {
+    this.pipeline.release()
+    this.input = null
+    this.samples = new Float32Array(0)
+    this.gpuCapable = true
+  }
+}
@@ -0,0 +1,173 @@
+import { describe, it, expect, vi, beforeEach } from 'vitest'
+import { LibRawWorkerPool, THUMBNAIL_MIN_SIZE } from './worker-pool'
+import { compileLibRawWasm } from './wasm-loader-helper'
+
+const MB = 1024 * 1024
+
+const { FakeClient } = vi.hoisted(() => {
+  // Stands in for a worker; tests set heap to what the worker would report
+  class FakeClient {
+    static created: FakeClient[] = []
+    heap = 0
+    disposed = false
+
+    constructor(public options: any) {
+      FakeClient.created.push(this)
+    }
+
+    async getHeapSize() {
+      return this.heap
+    }
+
+    async loadFile() {}
+
+    async process(params: any) {
+      return params
+    }
+
+    async encode(params: any, options: any) {
+      return { params, options }
+    }
+
+    async extractThumbnail(file: File, options: any) {
+      return { file, options }
+    }
+
+    async dispose() {
+      this.disposed = true
+    }
+  }
+  return { FakeClient }
+})
+
+vi.mock('./client', () => ({ LibRawClient: FakeClient }))
+
+vi.mock('./wasm-loader-helper', () => ({
+  isSimdSupported: () => true,
+  compileLibRawWasm: vi.fn(async () => ({ compiled: true })),
+}))
+
+function deferred() {
+  let resolve!: () => void
+  const promise = new Promise<void>(r => { resolve = r })
+  return { promise, resolve }
+}
+
+describe('LibRawWorkerPool', () => {
+  beforeEach(() => {
+    FakeClient.created = []
+    vi.clearAllMocks()
+  })
+
+  it('should run up to size jobs at once on workers sharing one compiled module', async () => {
+    const pool = new LibRawWorkerPool({ size: 2 })
+    const gates = [deferred(), deferred(), deferred()]
+    const used: any[] = []
+
+    const jobs = gates.map(gate => pool.run(async client => {
+      used.push(client)
+      await gate.promise
+    }))
+
+    await vi.waitFor(() => expect(used).toHaveLength(2))
+    expect(pool.queued).toBe(1)
+
+    gates[0].resolve()
+    await vi.waitFor(() => expect(used).toHaveLength(3))
+    expect(used[2]).toBe(used[0])
+
+    gates[1].resolve()
+    gates[2].resolve()
+    await Promise.all(jobs)
+
+    expect(FakeClient.created).toHaveLength(2)
+    expect(compileLibRawWasm).toHaveBeenCalledTimes(1)
+    expect(FakeClient.created[0].options).toEqual({ variant: 'simd', wasmModule: { compiled: true } })
+  })
+
+  it('should reject jobs beyond the queue bound and let forEach wait instead', async () => {
+    const pool = new LibRawWorkerPool({ size: 1, maxQueue: 1 })
+    const gate = deferred()
+
+    const running = pool.run(() => gate.promise)
+    const waiting = pool.run(async () => {})
+    await expect(pool.run(async () => {})).rejects.toThrow('queue is full')
+
+    gate.resolve()
+    await Promise.all([running, waiting])
+
+    const results: number[] = []
+    let maxQueued = 0
+    await pool.forEach(
+      [1, 2, 3, 4],
+      async (_client, item) => {
+        maxQueued = Math.max(maxQueued, pool.queued)
+        return item * 10
+      },
+      (_item, result) => results.push(result!)
+    )
+
+    expect(results).toEqual([10, 20, 30, 40])
+    expect(maxQueued).toBeLessThanOrEqual(1)
+  })
+
+  it('should hold jobs whose heap does not fit next to the running ones', async () => {
+    const pool = new LibRawWorkerPool({ size: 2, heapBudget: 200 * MB })
+    const gate = deferred()
+    const used: any[] = []
+
+    const first = pool.run(async (client: any) => {
+      used.push(client)
+      client.heap = 90 * MB
+      await gate.promise
+    }, { heapEstimate: 120 * MB })
+    const second = pool.run(async (client: any) => {
+      used.push(client)
+    }, { heapEstimate: 120 * MB })
+
+    await vi.waitFor(() => expect(used).toHaveLength(1))
+    expect(pool.queued).toBe(1)
+
+    gate.resolve()
+    await Promise.all([first, second])
+
+    // The worker that already grew to 90 MB needs the least extra heap
+    expect(used[1]).toBe(used[0])
+  })
+
+  it('should replace a worker whose heap outgrew its share of the budget', async () => {
+    const pool = new LibRawWorkerPool({ size: 2, heapBudget: 100 * MB })
+
+    await pool.run(async (client: any) => {
+      client.heap = 80 * MB
+    })
+    await vi.waitFor(() => expect(FakeClient.created[0].disposed).toBe(true))
+
+    await pool.run(async () => {})
+    expect(FakeClient.created).toHaveLength(2)
+  })
+
+  it('should plan preview renders within the per-worker share of the budget', async () => {
+    const pool = new LibRawWorkerPool({ size: 4, heapBudget: 400 * MB })
+    const file = new File(['raw'], 'a.ARW')
+
+    const params: any = await pool.renderPreview(file, { quality: 0 })
+    expect(params).toEqual({ memoryBudget: 100 * MB, quality: 0, halfSize: true })
+  })
+
+  it('should ask for a binned thumbnail when the embedded one is too small for a grid cell', async () => {
+    const pool = new LibRawWorkerPool({ size: 1 })
+    const file = new File(['raw'], 'a.DNG')
+
+    const extracted: any = await pool.extractThumbnail(file)
+    expect(extracted).toEqual({ file, options: { minSize: THUMBNAIL_MIN_SIZE } })
+  })
+
+  it('should plan exports within the per-worker share of the budget', async () => {
+    const pool = new LibRawWorkerPool({ size: 2, heapBudget: 400 * MB })
+    const file = new File(['raw'], 'a.ARW')
+
+    const encoded: any = await pool.exportFile(file, { quality: 3 }, { format: 'jpeg' })
+    expect(encoded).toEqual({ params: { memoryBudget: 200 * MB, quality: 3 }, options: { format: 'jpeg' } })
+  })
+})
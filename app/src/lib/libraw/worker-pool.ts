@@ -0,0 +1,264 @@
+"use client"
+
+import { EncodeOptions, EncodedImage, ExtractedThumbnail, ProcessParams } from "@/lib/types"
+import { LibRawClient } from "./client"
+import { compileLibRawWasm, isSimdSupported } from "./wasm-loader-helper"
+
+// Beyond this, workers mostly compete for memory bandwidth
+const MAX_POOL_SIZE = 8
+const DEFAULT_HEAP_BUDGET = 1024 * 1024 * 1024
+
+// Rough heap growth per byte of RAW file. Thumbnails read the header and
+// the embedded preview, or the file and its unpacked 16-bit data when
+// they have to be binned; a render holds the unpacked 16-bit data, the
+// 4-channel image and the RGBA output.
+const HEAP_PER_BYTE_THUMBNAIL = 4
+const HEAP_PER_BYTE_RENDER = 12
+
+export interface LibRawWorkerPoolOptions {
+  // Worker count, defaults to one less than navigator.hardwareConcurrency
+  size?: number
+  // Jobs waiting for a worker; run() rejects beyond this
+  maxQueue?: number
+  // Budget for the WASM heaps of all workers together, in bytes
+  heapBudget?: number
+}
+
+export interface PoolJobOptions {
+  // Heap the job may need, in bytes
+  heapEstimate?: number
+}
+
+type PoolTask<T> = (client: LibRawClient) => Promise<T>
+
+// Metadata and the embedded preview. Files without one of at least this
+// size (many DNGs) are unpacked for a binned preview instead; no render.
+export const THUMBNAIL_MIN_SIZE = 320
+
+export function readThumbnail(client: LibRawClient, file: File): Promise<ExtractedThumbnail> {
+  return client.extractThumbnail(file, { minSize: THUMBNAIL_MIN_SIZE })
+}
+
+export function thumbnailHeapEstimate(file: Blob): number {
+  return file.size * HEAP_PER_BYTE_THUMBNAIL
+}
+
+interface QueuedJob {
+  task: PoolTask<any>
+  heapEstimate: number
+  resolve: (value: any) => void
+  reject: (error: Error) => void
+}
+
+interface WorkerSlot {
+  client: LibRawClient | null
+  // Last reported heap size; WASM memory never shrinks
+  heap: number
+  // Estimate of the running job, until the worker reports its heap
+  reserved: number
+  busy: boolean
+}
+
+// Runs independent jobs (library thumbnails, batch renders) on several
+// LibRaw workers. Every worker instantiates the same compiled wasm and keeps
+// its own LibRaw instance, so jobs on different workers never share state.
+export class LibRawWorkerPool {
+  private readonly slots: WorkerSlot[]
+  private readonly maxQueue: number
+  private readonly heapBudget: number
+  private queue: QueuedJob[] = []
+  private spaceWaiters: Array<() => void> = []
+  private wasmModule: Promise<WebAssembly.Module | null> | null = null
+  private disposed = false
+
+  constructor(options: LibRawWorkerPoolOptions = {}) {
+    const cores = typeof navigator !== "undefined" ? navigator.hardwareConcurrency || 4 : 4
+    // One core stays free for the page and the editor's own worker
+    const size = Math.max(1, options.size ?? Math.min(MAX_POOL_SIZE, cores - 1))
+
+    this.slots = Array.from({ length: size }, () => ({ client: null, heap: 0, reserved: 0, busy: false }))
+    this.maxQueue = options.maxQueue ?? size * 4
+    this.heapBudget = options.heapBudget ?? DEFAULT_HEAP_BUDGET
+  }
+
+  get size(): number {
+    return this.slots.length
+  }
+
+  // Jobs waiting for a worker, not counting running ones
+  get queued(): number {
+    return this.queue.length
+  }
+
+  run<T>(task: PoolTask<T>, options: PoolJobOptions = {}): Promise<T> {
+    if (this.disposed) {
+      return Promise.reject(new Error("LibRaw worker pool disposed"))
+    }
+    if (this.queue.length >= this.maxQueue) {
+      return Promise.reject(new Error("LibRaw worker pool queue is full"))
+    }
+
+    return new Promise((resolve, reject) => {
+      this.queue.push({ task, heapEstimate: options.heapEstimate ?? 0, resolve, reject })
+      this.pump()
+    })
+  }
+
+  // Resolves once run() would accept another job
+  waitForSpace(): Promise<void> {
+    if (this.queue.length < this.maxQueue) return Promise.resolve()
+    return new Promise(resolve => this.spaceWaiters.push(resolve))
+  }
+
+  // Feeds every item through run(), waiting whenever the queue is full, so
+  // a large import holds at most maxQueue jobs. onResult gets null and the
+  // error for a failed item.
+  async forEach<I, T>(
+    items: Iterable<I>,
+    task: (client: LibRawClient, item: I) => Promise<T>,
+    onResult: (item: I, result: T | null, error?: Error) => void,
+    heapEstimate: (item: I) => number = () => 0
+  ): Promise<void> {
+    const jobs: Promise<void>[] = []
+    for (const item of items) {
+      await this.waitForSpace()
+      if (this.disposed) break
+
+      jobs.push(
+        this.run(client => task(client, item), { heapEstimate: heapEstimate(item) }).then(
+          result => onResult(item, result),
+          error => onResult(item, null, error)
+        )
+      )
+    }
+    await Promise.all(jobs)
+  }
+
+  extractThumbnail(file: File): Promise<ExtractedThumbnail> {
+    return this.run(client => readThumbnail(client, file), { heapEstimate: thumbnailHeapEstimate(file) })
+  }
+
+  // Half-size render, e.g. for a grid of quick previews. The worker plans
+  // the render within its share of the heap budget.
+  renderPreview(file: File, params: ProcessParams): Promise<ImageData | null> {
+    const memoryBudget = this.heapBudget / this.slots.length
+    return this.run(
+      async client => {
+        await client.loadFile(file)
+        return client.process({ memoryBudget, ...params, halfSize: true })
+      },
+      { heapEstimate: file.size * HEAP_PER_BYTE_RENDER }
+    )
+  }
+
+  // Full render encoded in the worker, e.g. one file of a batch export.
+  // Planned like renderPreview(); null when the build cannot encode
+  // options.format.
+  exportFile(file: File, params: ProcessParams, options: EncodeOptions): Promise<EncodedImage | null> {
+    const memoryBudget = this.heapBudget / this.slots.length
+    return this.run(
+      async client => {
+        await client.loadFile(file)
+        return client.encode({ memoryBudget, ...params }, options)
+      },
+      { heapEstimate: file.size * HEAP_PER_BYTE_RENDER }
+    )
+  }
+
+  async dispose(): Promise<void> {
+    this.disposed = true
+
+    const error = new Error("LibRaw worker pool disposed")
+    this.queue.splice(0).forEach(job => job.reject(error))
+    this.spaceWaiters.splice(0).forEach(resolve => resolve())
+
+    await Promise.all(this.slots.map(slot => slot.client?.dispose()))
+    this.slots.forEach(slot => {
+      slot.client = null
+      slot.heap = 0
+    })
+  }
+
+  private totalHeap(): number {
+    return this.slots.reduce((sum, slot) => sum + Math.max(slot.heap, slot.reserved), 0)
+  }
+
+  // Starts jobs while idle workers are left and the heap a job may add
+  // fits in the budget. One job always runs, however large.
+  private pump() {
+    while (this.queue.length > 0) {
+      const idle = this.slots.filter(slot => !slot.busy)
+      if (idle.length === 0) break
+
+      // The worker with the largest heap grows the least
+      const slot = idle.reduce((a, b) => (b.heap > a.heap ? b : a))
+      const job = this.queue[0]
+      const growth = Math.max(0, job.heapEstimate - slot.heap)
+      const running = idle.length < this.slots.length
+      if (running && this.totalHeap() + growth > this.heapBudget) break
+
+      this.queue.shift()
+      this.spaceWaiters.shift()?.()
+      this.start(slot, job)
+    }
+  }
+
+  private async start(slot: WorkerSlot, job: QueuedJob) {
+    slot.busy = true
+    slot.reserved = job.heapEstimate
+    try {
+      if (!slot.client) {
+        slot.client = await this.createClient()
+      }
+      job.resolve(await job.task(slot.client))
+    } catch (error) {
+      job.reject(error instanceof Error ? error : new Error(String(error)))
+    }
+
+    await this.measure(slot)
+    slot.reserved = 0
+    slot.busy = false
+    if (!this.disposed) this.pump()
+  }
+
+  // A worker whose heap grew past its share of the budget is replaced;
+  // terminating it is the only way to give the memory back
+  private async measure(slot: WorkerSlot) {
+    const client = slot.client
+    if (!client) return
+
+    const heap = await client.getHeapSize().catch(() => null)
+    if (heap !== null) slot.heap = heap
+
+    if (slot.heap > this.heapBudget / this.slots.length) {
+      slot.client = null
+      slot.heap = 0
+      await client.dispose()
+    }
+  }
+
+  private async createClient(): Promise<LibRawClient> {
+    // Parallelism comes from the pool, so workers use a single-threaded build
+    const variant = isSimdSupported() ? "simd" : "single"
+
+    if (!this.wasmModule) {
+      this.wasmModule = compileLibRawWasm(variant).catch(error => {
+        console.warn("Failed to precompile LibRaw wasm, each worker compiles its own:", error)
+        return null
+      })
+    }
+    const wasmModule = await this.wasmModule
+
+    return new LibRawClient(wasmModule ? { variant, wasmModule } : { variant })
+  }
+}
+
+// Shared by the library page so that imports keep running after navigation
+let poolInstance: LibRawWorkerPool | null = null
+
+export function getLibRawWorkerPool(): LibRawWorkerPool {
+  if (!poolInstance) {
+    poolInstance = new LibRawWorkerPool()
+  }
+  return poolInstance
+}
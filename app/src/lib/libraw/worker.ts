@@ -1,22 +1,212 @@
-import { WorkerMessage, WorkerResponse, ProcessParams, LibRawProcessor } from "@/lib/types"
+import { WorkerMessage, WorkerResponse, ProcessParams, ProcessedImage, LibRawProcessor, ExtractedThumbnail, ImageRegion } from "@/lib/types"
 import { createProcessor } from "./processor-factory"
+import { FrameRing, RingFrame } from "./frame-ring"
+import { tensorToRGBA } from "@/lib/metaisp/tensor-convert"
+import { UnpackedCache, RGBAImage, unpackedCacheKey, downscaleRGBA, encodePreview } from "./unpacked-cache"
 
 let processor: LibRawProcessor | null = null
 
+// Opened on the first load; null when the context has no OPFS
+let unpackedCache: Promise<UnpackedCache | null> | null = null
+
+// Cache state of the loaded file. The snapshot is stored after the first
+// full render (which unpacked the file), the preview after every one.
+interface CachedFileState {
+  key: string
+  cache: UnpackedCache
+  stored: boolean
+  // Latest preview waiting for the write in flight
+  pendingPreview: RGBAImage | null
+  writing: boolean
+}
+let cachedFile: CachedFileState | null = null
+
+// Highest process seq the client has asked for. The client also writes it
+// to cancelSignal (a SharedArrayBuffer, when cross-origin isolated), which
+// is the only way to see it while a render blocks this thread.
+let latestRenderSeq = 0
+let cancelSignal: Int32Array | null = null
+
+function isSuperseded(seq: number): boolean {
+  const signalled = cancelSignal ? Atomics.load(cancelSignal, 0) : 0
+  return Math.max(latestRenderSeq, signalled) > seq
+}
+
+function isAbortError(error: unknown): boolean {
+  return typeof error === "object" && error !== null && (error as { name?: string }).name === "AbortError"
+}
+
+// Half-size output needs no demosaic, so quality only matters for full renders
+const PREVIEW_OVERRIDES: Partial<ProcessParams> = { halfSize: true, quality: 0 }
+
+// Previews and region renders go into the frame ring, which is created
+// with the first of them and replaced when one does not fit. Full renders
+// outlive the next frame (history, comparisons), so they keep a buffer of
+// their own.
+let frameRing: FrameRing | null = null
+let frameRingSent = false
+// Slot the render in progress claimed, -1 for none
+let ringSlot = -1
+
+// RenderOptions.output of ring frames; null (a new buffer) without
+// cross-origin isolation or while the client holds every slot
+function ringOutput(byteLength: number): Uint8Array | null {
+  if (!FrameRing.isSupported()) return null
+  if (!frameRing || frameRing.slotBytes < byteLength) {
+    frameRing = FrameRing.create(byteLength)!
+    frameRingSent = false
+  }
+  ringSlot = frameRing.acquire()
+  return ringSlot < 0 ? null : frameRing.view(ringSlot, byteLength)
+}
+
+// Gives back a slot that the render in progress claimed but did not post
+function releaseRingSlot() {
+  if (ringSlot >= 0) frameRing?.release(ringSlot)
+  ringSlot = -1
+}
+
+function postImage(type: "processed" | "preview" | "region", id: string, image: ProcessedImage, region?: ImageRegion) {
+  // A ring frame only posts its slot; anything else transfers its buffer
+  // to avoid copying
+  const slot = frameRing ? frameRing.slotOf(image.data) : -1
+  let frame: RingFrame | undefined
+  if (slot >= 0) {
+    frame = { slot, byteLength: image.data.byteLength, ring: frameRingSent ? undefined : frameRing!.buffer }
+    frameRingSent = true
+    frameRing!.publish(slot)
+    ringSlot = -1
+  } else {
+    releaseRingSlot()
+  }
+  
+  const response: WorkerResponse = {
+    type,
+    id,
+    data: {
+      data: frame ? undefined : image.data.buffer,
+      frame,
+      width: image.width,
+      height: image.height,
+      metadata: image.metadata,
+      analysis: image.analysis,
+      scale: image.scale,
+      region,
+    },
+  }
+  // All analysis arrays share one buffer
+  const transfer: Transferable[] = frame ? [] : [image.data.buffer]
+  if (image.analysis) transfer.push(image.analysis.histogram.buffer)
+  self.postMessage(response, transfer)
+}
+
+// Region renders and full renders share one seq, so either kind of newer
+// request supersedes both
+function renderCancelCheck(data: { seq?: number; cancelSignal?: Int32Array }): () => boolean {
+  if (data.cancelSignal) {
+    cancelSignal = data.cancelSignal
+  }
+  const seq: number = data.seq ?? 0
+  latestRenderSeq = Math.max(latestRenderSeq, seq)
+  return () => seq > 0 && isSuperseded(seq)
+}
+
+// Restores file from the unpacked cache into processor; null on a miss
+async function loadFromUnpackedCache(file: Blob): Promise<{ preview: Blob | null } | null> {
+  if (!processor?.loadUnpackedSnapshot) return null
+  
+  unpackedCache ??= UnpackedCache.open()
+  const cache = await unpackedCache
+  const key = cache ? await unpackedCacheKey(file) : null
+  if (!cache || !key) return null
+  
+  cachedFile = { key, cache, stored: false, pendingPreview: null, writing: false }
+  const entry = await cache.get(key)
+  if (!entry) return null
+  
+  let restored = false
+  try {
+    restored = await processor.loadUnpackedSnapshot(entry.snapshot)
+  } catch (error) {
+    console.warn("Failed to restore from the unpacked cache:", error)
+  }
+  if (!restored) {
+    await cache.delete(key)
+    return null
+  }
+  cachedFile.stored = true
+  return { preview: entry.preview }
+}
+
+// Stores the snapshot (once) and the preview of a finished full render.
+// Runs after the image was posted; the snapshot is taken synchronously,
+// before another message can replace the loaded file.
+async function updateUnpackedCache(state: CachedFileState, preview: RGBAImage): Promise<void> {
+  try {
+    if (!state.stored) {
+      state.stored = true
+      const snapshot = processor?.createUnpackedSnapshot?.()
+      if (!snapshot) return
+      await state.cache.put(state.key, snapshot)
+    }
+    
+    state.pendingPreview = preview
+    if (state.writing) return
+    state.writing = true
+    try {
+      while (state.pendingPreview) {
+        const image = state.pendingPreview
+        state.pendingPreview = null
+        const blob = await encodePreview(image)
+        if (blob) await state.cache.putPreview(state.key, blob)
+      }
+    } finally {
+      state.writing = false
+    }
+  } catch (error) {
+    console.warn("Failed to update the unpacked cache:", error)
+  }
+}
+
+// Lets queued messages (e.g. 'cancel') run before the next render starts
+function yieldToMessages(): Promise<void> {
+  return new Promise(resolve => setTimeout(resolve, 0))
+}
+
 // Handle messages from main thread
 self.addEventListener("message", async (event: MessageEvent<WorkerMessage>) => {
   const { type, id, data } = event.data
 
   try {
     switch (type) {
+      case "init": {
+        processor = await createProcessor({ variant: data?.variant, wasmModule: data?.wasmModule, backend: data?.backend })
+        
+        const response: WorkerResponse = { type: "initialized", id }
+        self.postMessage(response)
+        break
+      }
+
       case "load": {
         // Initialize processor if needed
         if (!processor) {
           processor = await createProcessor()
         }
         
-        // Load the file
-        await processor.loadFile(data.buffer)
+        // Load the file. A posted File is only a handle, so streaming it
+        // keeps the RAW bytes out of the worker's JS heap. Recent files
+        // come from the unpacked cache without reading them at all.
+        cachedFile = null
+        const cached = data.file ? await loadFromUnpackedCache(data.file) : null
+        if (!cached) {
+          if (data.file && processor.loadBlob) {
+            await processor.loadBlob(data.file)
+          } else if (data.file) {
+            await processor.loadFile(await data.file.arrayBuffer())
+          } else {
+            await processor.loadFile(data.buffer)
+          }
+        }
         
         // Get metadata immediately
         const metadata = processor.getMetadata()
@@ -25,7 +215,7 @@ self.addEventListener("message", async (event: MessageEvent<WorkerMessage>) => {
         const response: WorkerResponse = {
           type: "loaded",
           id,
-          data: { metadata },
+          data: { metadata, cached: !!cached, preview: cached?.preview ?? null },
         }
         self.postMessage(response)
         break
@@ -36,22 +226,99 @@ self.addEventListener("message", async (event: MessageEvent<WorkerMessage>) => {
           throw new Error("Processor not initialized")
         }
         
-        // Process with given parameters
-        const processedImage = await processor.process(data.params as ProcessParams)
+        const isCancelled = renderCancelCheck(data)
+        const params = data.params as ProcessParams
+        let partial = false
+        
+        try {
+          // Progressive: a fast proxy first, unless the full render is cheap
+          // anyway because its demosaic stage is cached. The binned preview
+          // skips demosaic; sensors it cannot bin get a half-size render.
+          if (data.progressive && !params.halfSize && !processor.canReuseDemosaic?.(params)) {
+            const preview = (await processor.renderBinnedPreview?.(params, undefined, { isCancelled, output: ringOutput })) ?? {
+              ...await processor.process(
+                { ...params, ...PREVIEW_OVERRIDES },
+                { cacheDemosaic: false, isCancelled, output: ringOutput }
+              ),
+              scale: 2,
+            }
+            postImage("preview", id, preview)
+            partial = true
+            
+            await yieldToMessages()
+          }
+          
+          // Process with given parameters
+          const processedImage = await processor.process(params, { isCancelled })
+          // Taken before postImage() transfers the pixels away
+          const cacheState = cachedFile
+          const preview = cacheState ? downscaleRGBA(processedImage) : null
+          postImage("processed", id, processedImage)
+          if (cacheState && preview) void updateUnpackedCache(cacheState, preview)
+        } catch (error) {
+          releaseRingSlot()
+          if (!isAbortError(error)) throw error
+          
+          const response: WorkerResponse = { type: "cancelled", id, data: { partial } }
+          self.postMessage(response)
+        }
+        break
+      }
+
+      case "process-region": {
+        if (!processor) {
+          throw new Error("Processor not initialized")
+        }
+        if (!processor.processRegion) {
+          throw new Error("Region rendering is not supported")
+        }
+        
+        const isCancelled = renderCancelCheck(data)
+        try {
+          const { image, region } = await processor.processRegion(data.params, data.region, data.scale, { isCancelled, output: ringOutput })
+          postImage("region", id, image, region)
+        } catch (error) {
+          releaseRingSlot()
+          if (!isAbortError(error)) throw error
+          
+          const response: WorkerResponse = { type: "cancelled", id, data: { partial: false } }
+          self.postMessage(response)
+        }
+        break
+      }
+
+      case "process-linear": {
+        if (!processor) {
+          throw new Error("Processor not initialized")
+        }
         
-        // Transfer the buffer to avoid copying
+        const linear = (await processor.processLinear?.(data.params, data.format)) ?? null
         const response: WorkerResponse = {
-          type: "processed",
+          type: "linear",
           id,
-          data: {
-            data: processedImage.data.buffer,
-            width: processedImage.width,
-            height: processedImage.height,
-            metadata: processedImage.metadata,
-          },
+          data: linear && { ...linear, data: linear.data.buffer },
+        }
+        self.postMessage(response, linear ? [linear.data.buffer] : [])
+        break
+      }
+
+      case "encode": {
+        if (!processor) {
+          throw new Error("Processor not initialized")
         }
         
-        self.postMessage(response, [processedImage.data.buffer])
+        const encoded = (await processor.encode?.(data.params, data.options)) ?? null
+        const response: WorkerResponse = {
+          type: "encoded",
+          id,
+          data: encoded && { ...encoded, data: encoded.data.buffer },
+        }
+        self.postMessage(response, encoded ? [encoded.data.buffer] : [])
+        break
+      }
+
+      case "cancel": {
+        latestRenderSeq = Math.max(latestRenderSeq, data.seq)
         break
       }
 
@@ -72,11 +339,86 @@ self.addEventListener("message", async (event: MessageEvent<WorkerMessage>) => {
         break
       }
 
+      case "get-thumbnail-only": {
+        if (!processor) {
+          processor = await createProcessor()
+        }
+        
+        let extracted: ExtractedThumbnail
+        if (processor.extractThumbnail) {
+          extracted = await processor.extractThumbnail(data.file, { minSize: data.minSize })
+          // Binned previews are RGBA; encode them like embedded ones
+          const thumbnail = extracted.thumbnail
+          if (thumbnail?.format === "rgba") {
+            const pixels = new Uint8ClampedArray(thumbnail.data.buffer, thumbnail.data.byteOffset, thumbnail.data.length)
+            const jpeg = await encodePreview({ data: pixels, width: thumbnail.width, height: thumbnail.height })
+            if (jpeg) {
+              extracted.thumbnail = { format: "jpeg", width: thumbnail.width, height: thumbnail.height, data: new Uint8Array(await jpeg.arrayBuffer()) }
+            }
+          }
+        } else {
+          // No fast path (mock): a regular load
+          await processor.loadFile(await data.file.arrayBuffer())
+          extracted = { metadata: processor.getMetadata(), thumbnail: processor.getThumbnail?.() ?? null }
+        }
+        
+        const response: WorkerResponse = {
+          type: "thumbnail",
+          id,
+          data: extracted,
+        }
+        self.postMessage(response, extracted.thumbnail ? [extracted.thumbnail.data.buffer] : [])
+        break
+      }
+
+      case "convert-tensor": {
+        if (!processor) {
+          processor = await createProcessor()
+        }
+        
+        const { tensor, srcWidth, srcHeight, options } = data
+        const converted = processor.convertTensor?.(tensor, srcWidth, srcHeight, options) ?? {
+          data: tensorToRGBA(tensor, srcWidth, srcHeight, options),
+          width: options.width ?? srcWidth,
+          height: options.height ?? srcHeight,
+        }
+        
+        const response: WorkerResponse = {
+          type: "converted",
+          id,
+          data: { data: converted.data.buffer, width: converted.width, height: converted.height },
+        }
+        self.postMessage(response, [converted.data.buffer])
+        break
+      }
+
+      case "get-heap-size": {
+        const response: WorkerResponse = {
+          type: "heap-size",
+          id,
+          data: { heapSize: processor?.getHeapSize?.() ?? null },
+        }
+        self.postMessage(response)
+        break
+      }
+
+      case "get-memory-stats": {
+        const response: WorkerResponse = {
+          type: "memory-stats",
+          id,
+          data: { stats: processor?.getMemoryStats?.() ?? null },
+        }
+        self.postMessage(response)
+        break
+      }
+
       case "dispose": {
         if (processor) {
           processor.dispose()
           processor = null
         }
+        cachedFile = null
+        frameRing = null
         
         const response: WorkerResponse = {
           type: "disposed",
@@ -4,13 +4,58 @@
  */
 
 import * as ort from 'onnxruntime-web';
+import { MetaISPTileSource, TileBlender, fullFrameTileSource, planTiles } from './tiling';
+import { tensorToRGBA } from './tensor-convert';
+import type { TensorConversionOptions } from '@/lib/types';
+
+/**
+ * Converts model output [3, srcHeight, srcWidth] to RGBA, e.g.
+ * LibRawClient.convertTensor(), which runs natively in the LibRaw worker.
+ * It may take ownership of the tensor.
+ */
+export type MetaISPOutputConverter = (
+  tensor: Float32Array,
+  srcWidth: number,
+  srcHeight: number,
+  options: TensorConversionOptions
+) => Promise<ImageData>;
 
 export interface MetaISPConfig {
   modelPath: string;
   executionProvider?: 'webgpu' | 'wasm';
   enableProgress?: boolean;
+  // Tile edge in full-resolution pixels for tiled inference
+  tileSize?: number;
+  // Pixels shared by neighbouring tiles, feathered across the seam
+  tileOverlap?: number;
+  // Frames above this many pixels are processed in tiles
+  maxSinglePassPixels?: number;
+  // Output conversion off the main thread; in-thread JS without it
+  convertOutput?: MetaISPOutputConverter;
+  // Model output is linear and needs sRGB encoding
+  srgbOutput?: boolean;
 }
 
+export interface MetaISPInputs {
+  raw: Float32Array;
+  raw_full: Float32Array;
+  wb: Float32Array;
+  device: Int32Array;
+  iso: Float32Array;
+  exp: Float32Array;
+  dimensions: {
+    rawWidth: number;
+    rawHeight: number;
+    fullWidth: number;
+    fullHeight: number;
+  };
+}
+
+const DEFAULT_TILE_SIZE = 512;
+const DEFAULT_TILE_OVERLAP = 64;
+// Roughly where a single pass runs out of memory on WebGPU
+const DEFAULT_MAX_SINGLE_PASS_PIXELS = 12_000_000;
+
 export interface ProcessingProgress {
   stage: 'loading' | 'preparing' | 'processing' | 'finalizing';
   progress: number;
@@ -93,24 +138,16 @@ export class MetaISPProcessor {
   /**
    * Process RAW data through MetaISP
    */
-  async process(inputs: {
-    raw: Float32Array;
-    raw_full: Float32Array;
-    wb: Float32Array;
-    device: Int32Array;
-    iso: Float32Array;
-    exp: Float32Array;
-    dimensions: { 
-      rawWidth: number; 
-      rawHeight: number; 
-      fullWidth: number; 
-      fullHeight: number; 
-    };
-  }): Promise<ImageData> {
+  async process(inputs: MetaISPInputs): Promise<ImageData> {
     if (!this.session) {
       throw new Error('MetaISP not initialized');
     }
     
+    const { fullWidth: width, fullHeight: height } = inputs.dimensions;
+    if (this.needsTiling(width, height)) {
+      return this.processTiled(inputs);
+    }
+    
     this.reportProgress('preparing', 0, 'Preparing input tensors...');
     
     try {
@@ -142,7 +179,7 @@ export class MetaISPProcessor {
       const output = results[outputName] as ort.Tensor;
       
       // Convert to ImageData
-      const imageData = this.tensorToImageData(
+      const imageData = await this.tensorToImageData(
         output.data as Float32Array,
         output.dims as number[],
         fullWidth,
@@ -160,74 +197,132 @@ export class MetaISPProcessor {
   }
   
   /**
-   * Process with tiling for large images
+   * Whether process() splits a frame of this size into tiles
+   */
+  needsTiling(width: number, height: number): boolean {
+    return width * height > (this.config.maxSinglePassPixels ?? DEFAULT_MAX_SINGLE_PASS_PIXELS);
+  }
+  
+  /**
+   * Process with tiling for large images. Tensors are sized by the tile,
+   * so memory stays the same whatever the sensor size. Two sets of tile
+   * buffers alternate: the next tile is packed while the current one runs.
+   * A source packs tiles itself instead of cutting them from inputs.raw and
+   * inputs.raw_full, which may then be empty.
    */
   async processTiled(
-    inputs: any,
-    tileSize: number = 512,
-    overlap: number = 64
+    inputs: MetaISPInputs,
+    tileSize: number = this.config.tileSize ?? DEFAULT_TILE_SIZE,
+    overlap: number = this.config.tileOverlap ?? DEFAULT_TILE_OVERLAP,
+    source?: MetaISPTileSource
   ): Promise<ImageData> {
-    // TODO: Implement tiled processing for large images
-    throw new Error('Tiled processing not yet implemented');
+    if (!this.session) {
+      throw new Error('MetaISP not initialized');
+    }
+    
+    const session = this.session;
+    const { fullWidth, fullHeight } = inputs.dimensions;
+    const tiles = planTiles(fullWidth, fullHeight, tileSize, overlap);
+    const { width: tileWidth, height: tileHeight } = tiles[0];
+    const tileSource = source ?? fullFrameTileSource(inputs.raw, inputs.raw_full, fullWidth, fullHeight);
+    const blender = new TileBlender(fullWidth, fullHeight, tileSize, overlap, this.config.srgbOutput);
+    
+    this.reportProgress('preparing', 0, `Preparing ${tiles.length} tiles...`);
+    
+    const rawLength = 4 * (tileHeight >> 1) * (tileWidth >> 1);
+    const fullLength = 3 * tileHeight * tileWidth;
+    const buffers = [0, 1].map(() =>
+      tileSource.allocate?.(rawLength, fullLength) ?? {
+        raw: new Float32Array(rawLength),
+        rawFull: new Float32Array(fullLength),
+      }
+    );
+    
+    // Scalar inputs are the same for every tile
+    const wb = new ort.Tensor('float32', inputs.wb, [1, 4]);
+    const device = new ort.Tensor('int32', inputs.device, [1]);
+    const iso = new ort.Tensor('float32', inputs.iso, [1]);
+    const exp = new ort.Tensor('float32', inputs.exp, [1]);
+    
+    try {
+      const startTime = performance.now();
+      await tileSource.packTile(tiles[0], buffers[0]);
+      
+      for (let i = 0; i < tiles.length; i++) {
+        const tile = tiles[i];
+        const current = buffers[i & 1];
+        
+        this.reportProgress('processing', Math.round((i / tiles.length) * 100), `Running tile ${i + 1} of ${tiles.length}...`);
+        
+        const run = session.run({
+          raw: new ort.Tensor('float32', current.raw, [1, 4, tile.height >> 1, tile.width >> 1]),
+          raw_full: new ort.Tensor('float32', current.rawFull, [1, 3, tile.height, tile.width]),
+          wb,
+          device,
+          iso,
+          exp
+        });
+        
+        if (i + 1 < tiles.length) {
+          const next = buffers[(i + 1) & 1];
+          await Promise.all([run, tileSource.packTile(tiles[i + 1], next)]);
+        }
+        const results = await run;
+        
+        const output = results[session.outputNames[0]] as ort.Tensor;
+        const [batch, channels, height, width] = output.dims as number[];
+        if (batch !== 1 || channels !== 3 || height !== tile.height || width !== tile.width) {
+          throw new Error(`Unexpected tile output dimensions: ${output.dims}`);
+        }
+        
+        blender.add(tile, output.data as Float32Array);
+      }
+      
+      console.log(`MetaISP tiled inference (${tiles.length} tiles) completed in ${(performance.now() - startTime).toFixed(2)}ms`);
+      
+      this.reportProgress('finalizing', 0, 'Blending tiles...');
+      const imageData = blender.finish();
+      this.reportProgress('finalizing', 100, 'Processing complete');
+      
+      return imageData;
+      
+    } catch (error) {
+      console.error('MetaISP tiled processing failed:', error);
+      throw new Error(`Tiled processing failed: ${error}`);
+    }
   }
   
   /**
-   * Convert tensor output to ImageData
+   * Convert tensor output to ImageData, resized to the expected size
    */
-  private tensorToImageData(
+  private async tensorToImageData(
     tensor: Float32Array,
     dims: number[],
     expectedWidth: number,
     expectedHeight: number
-  ): ImageData {
+  ): Promise<ImageData> {
     const [batch, channels, height, width] = dims;
     
     if (batch !== 1 || channels !== 3) {
       throw new Error(`Unexpected output dimensions: ${dims}`);
     }
     
-    // Handle dimension mismatch
-    let finalWidth = width;
-    let finalHeight = height;
-    let needsResize = false;
-    
     if (width !== expectedWidth || height !== expectedHeight) {
       console.warn(`Output size mismatch. Expected: ${expectedWidth}x${expectedHeight}, got: ${width}x${height}`);
-      needsResize = true;
     }
     
-    // Convert CHW to HWC and normalize
-    const imageData = new ImageData(expectedWidth, expectedHeight);
-    const data = imageData.data;
-    
-    for (let y = 0; y < expectedHeight; y++) {
-      for (let x = 0; x < expectedWidth; x++) {
-        let srcX = x;
-        let srcY = y;
-        
-        // Simple nearest neighbor resize if needed
-        if (needsResize) {
-          srcX = Math.floor(x * width / expectedWidth);
-          srcY = Math.floor(y * height / expectedHeight);
-        }
-        
-        const dstIdx = (y * expectedWidth + x) * 4;
-        const srcIdx = srcY * width + srcX;
-        
-        // Assuming tensor is in CHW format
-        const r = tensor[0 * height * width + srcIdx];
-        const g = tensor[1 * height * width + srcIdx];
-        const b = tensor[2 * height * width + srcIdx];
-        
-        // Clamp and convert to uint8
-        data[dstIdx + 0] = Math.max(0, Math.min(255, Math.round(r * 255)));
-        data[dstIdx + 1] = Math.max(0, Math.min(255, Math.round(g * 255)));
-        data[dstIdx + 2] = Math.max(0, Math.min(255, Math.round(b * 255)));
-        data[dstIdx + 3] = 255;
+    const options = { width: expectedWidth, height: expectedHeight, srgb: this.config.srgbOutput };
+    if (this.config.convertOutput) {
+      try {
+        return await this.config.convertOutput(tensor, width, height, options);
+      } catch (error) {
+        // A transferred tensor is gone, so there is nothing to fall back to
+        if (tensor.byteLength === 0) throw error;
+        console.warn('MetaISP output conversion failed, converting in this thread:', error);
       }
     }
     
-    return imageData;
+    return new ImageData(tensorToRGBA(tensor, width, height, options), expectedWidth, expectedHeight);
   }
   
   /**
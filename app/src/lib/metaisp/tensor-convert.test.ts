@@ -0,0 +1,33 @@
+import { describe, it, expect } from 'vitest';
+import { tensorToRGBA } from './tensor-convert';
+
+// [3, height, width] with constant channels
+function constantTensor(width: number, height: number, rgb: number[]): Float32Array {
+  const plane = width * height;
+  const tensor = new Float32Array(3 * plane);
+  rgb.forEach((value, c) => tensor.fill(value, c * plane, (c + 1) * plane));
+  return tensor;
+}
+
+describe('tensorToRGBA', () => {
+  it('should interleave, clamp and round the planes', () => {
+    const tensor = new Float32Array([0.5, -0.2, 1, 1.5, 0.25, 0.1]);
+    expect(Array.from(tensorToRGBA(tensor, 2, 1))).toEqual([128, 255, 64, 255, 0, 255, 26, 255]);
+  });
+
+  it('should resize bilinearly between pixel centers', () => {
+    // 0 and 1 across two pixels, stretched to four
+    const tensor = new Float32Array([0, 1, 0, 1, 0, 1]);
+    const out = tensorToRGBA(tensor, 2, 1, { width: 4, height: 1 });
+    expect([0, 1, 2, 3].map(x => out[x * 4])).toEqual([0, 64, 191, 255]);
+
+    const flat = tensorToRGBA(constantTensor(5, 3, [0.2, 0.4, 0.6]), 5, 3, { width: 2, height: 7 });
+    expect(Array.from(flat.slice(0, 4))).toEqual([51, 102, 153, 255]);
+    expect(flat.length).toBe(2 * 7 * 4);
+  });
+
+  it('should encode linear values to sRGB', () => {
+    const out = tensorToRGBA(constantTensor(1, 1, [0, 0.5, 1]), 1, 1, { srgb: true });
+    expect(Array.from(out)).toEqual([0, 188, 255, 255]);
+  });
+});
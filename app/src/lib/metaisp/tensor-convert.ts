@@ -0,0 +1,97 @@
+/**
+ * MetaISP output conversion
+ * CHW float tensor to RGBA8 with clamping, bilinear resize and optional
+ * sRGB encoding. Same arithmetic as LibRaw.convertTensorToRGBA(), which
+ * the worker uses when the build has it.
+ */
+
+import type { TensorConversionOptions } from '@/lib/types';
+
+const SRGB_STEPS = 4095;
+let srgbTable: Uint8Array | null = null;
+
+function getSRGBTable(): Uint8Array {
+  if (!srgbTable) {
+    srgbTable = new Uint8Array(SRGB_STEPS + 1);
+    for (let i = 0; i <= SRGB_STEPS; i++) {
+      const v = i / SRGB_STEPS;
+      const encoded = v <= 0.0031308 ? v * 12.92 : 1.055 * Math.pow(v, 1 / 2.4) - 0.055;
+      srgbTable[i] = Math.floor(encoded * 255 + 0.5);
+    }
+  }
+  return srgbTable;
+}
+
+/**
+ * Clamps a 0..1 value and converts it to 8 bits, sRGB-encoded with srgb
+ */
+export function channelEncoder(srgb = false): (value: number) => number {
+  const table = srgb ? getSRGBTable() : null;
+  return (value: number) => {
+    const v = value < 0 ? 0 : value > 1 ? 1 : value;
+    return table ? table[Math.floor(v * SRGB_STEPS + 0.5)] : Math.floor(v * 255 + 0.5);
+  };
+}
+
+// Source index and weight of the next sample per output position,
+// sampling at pixel centers
+function bilinearTaps(from: number, to: number): { index: Int32Array; weight: Float32Array } {
+  const index = new Int32Array(to);
+  const weight = new Float32Array(to);
+  for (let i = 0; i < to; i++) {
+    const pos = Math.max(0, ((i + 0.5) * from) / to - 0.5);
+    const base = Math.min(Math.floor(pos), from - 1);
+    index[i] = base;
+    weight[i] = base + 1 < from ? pos - base : 0;
+  }
+  return { index, weight };
+}
+
+/**
+ * tensor is [3, srcHeight, srcWidth] with values 0..1
+ */
+export function tensorToRGBA(
+  tensor: Float32Array,
+  srcWidth: number,
+  srcHeight: number,
+  options: TensorConversionOptions = {}
+): Uint8ClampedArray {
+  const width = options.width ?? srcWidth;
+  const height = options.height ?? srcHeight;
+  const srcPlane = srcWidth * srcHeight;
+  const out = new Uint8ClampedArray(width * height * 4);
+
+  const encode = channelEncoder(options.srgb);
+
+  if (width === srcWidth && height === srcHeight) {
+    for (let i = 0; i < srcPlane; i++) {
+      out[i * 4] = encode(tensor[i]);
+      out[i * 4 + 1] = encode(tensor[srcPlane + i]);
+      out[i * 4 + 2] = encode(tensor[2 * srcPlane + i]);
+      out[i * 4 + 3] = 255;
+    }
+    return out;
+  }
+
+  const xs = bilinearTaps(srcWidth, width);
+  const ys = bilinearTaps(srcHeight, height);
+  for (let y = 0; y < height; y++) {
+    const top = ys.index[y] * srcWidth;
+    const fy = ys.weight[y];
+    const bottom = fy > 0 ? top + srcWidth : top;
+    for (let x = 0; x < width; x++) {
+      const left = xs.index[x];
+      const fx = xs.weight[x];
+      const right = fx > 0 ? left + 1 : left;
+      const dst = (y * width + x) * 4;
+      for (let c = 0; c < 3; c++) {
+        const p = c * srcPlane;
+        const upper = tensor[p + top + left] + (tensor[p + top + right] - tensor[p + top + left]) * fx;
+        const lower = tensor[p + bottom + left] + (tensor[p + bottom + right] - tensor[p + bottom + left]) * fx;
+        out[dst + c] = encode(upper + (lower - upper) * fy);
+      }
+      out[dst + 3] = 255;
+    }
+  }
+  return out;
+}
@@ -0,0 +1,72 @@
+import { describe, it, expect } from 'vitest';
+import { TileBlender, fullFrameTileSource, planTiles } from './tiling';
+
+// Planar RGB test pattern in [0, 1]
+function pattern(width: number, height: number): Float32Array {
+  const plane = width * height;
+  const data = new Float32Array(3 * plane);
+  for (let i = 0; i < plane; i++) {
+    data[i] = (i % width) / width;
+    data[plane + i] = Math.floor(i / width) / height;
+    data[2 * plane + i] = ((i * 7) % 255) / 255;
+  }
+  return data;
+}
+
+describe('planTiles', () => {
+  it('should cover the frame with even, overlapping tiles in raster order', () => {
+    const tiles = planTiles(1000, 700, 256, 32);
+    const covered = new Uint8Array(1000 * 700);
+
+    for (const tile of tiles) {
+      expect([tile.x, tile.y, tile.width, tile.height].every(v => v % 2 === 0)).toBe(true);
+      expect(tile.x + tile.width).toBeLessThanOrEqual(1000);
+      expect(tile.y + tile.height).toBeLessThanOrEqual(700);
+      for (let y = tile.y; y < tile.y + tile.height; y++) {
+        covered.fill(1, y * 1000 + tile.x, y * 1000 + tile.x + tile.width);
+      }
+    }
+
+    expect(covered.every(v => v === 1)).toBe(true);
+    const rows = tiles.map(tile => tile.y);
+    expect(rows).toEqual([...rows].sort((a, b) => a - b));
+  });
+
+  it('should use a single tile for a frame that fits', () => {
+    expect(planTiles(300, 200, 512, 64)).toEqual([{ x: 0, y: 0, width: 300, height: 200 }]);
+  });
+});
+
+describe('TileBlender', () => {
+  it('should reproduce the frame when every tile returns its input', () => {
+    const width = 90;
+    const height = 70;
+    const full = pattern(width, height);
+    const source = fullFrameTileSource(new Float32Array(width * height), full, width, height);
+    const blender = new TileBlender(width, height, 32, 8);
+
+    for (const tile of planTiles(width, height, 32, 8)) {
+      const buffers = {
+        raw: new Float32Array(tile.width * tile.height),
+        rawFull: new Float32Array(3 * tile.width * tile.height),
+      };
+      source.packTile(tile, buffers);
+      blender.add(tile, buffers.rawFull);
+    }
+    const image = blender.finish();
+
+    const plane = width * height;
+    for (let i = 0; i < plane; i++) {
+      expect(Math.abs(image.data[i * 4] - full[i] * 255)).toBeLessThanOrEqual(1);
+      expect(Math.abs(image.data[i * 4 + 1] - full[plane + i] * 255)).toBeLessThanOrEqual(1);
+      expect(Math.abs(image.data[i * 4 + 2] - full[2 * plane + i] * 255)).toBeLessThanOrEqual(1);
+      expect(image.data[i * 4 + 3]).toBe(255);
+    }
+  });
+
+  it('should reject tiles out of raster order', () => {
+    const blender = new TileBlender(64, 64, 32, 8);
+    blender.add({ x: 0, y: 24, width: 32, height: 32 }, new Float32Array(3 * 32 * 32));
+    expect(() => blender.add({ x: 0, y: 0, width: 32, height: 32 }, new Float32Array(3 * 32 * 32))).toThrow('raster order');
+  });
+});
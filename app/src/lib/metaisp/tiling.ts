@@ -0,0 +1,214 @@
+/**
+ * MetaISP tiling
+ * Splits a frame into overlapping tiles for inference and blends the
+ * tile outputs back together, so tensor memory depends on the tile size
+ * instead of the sensor size.
+ */
+
+import { channelEncoder } from './tensor-convert';
+
+/**
+ * Tile in full-resolution pixels. x, y, width and height are even so that
+ * the half-resolution Bayer planes split at the same place.
+ */
+export interface MetaISPTile {
+  x: number;
+  y: number;
+  width: number;
+  height: number;
+}
+
+/**
+ * Model inputs of one tile: raw as [4, height/2, width/2] Bayer planes and
+ * rawFull as [3, height, width]
+ */
+export interface MetaISPTileBuffers {
+  raw: Float32Array;
+  rawFull: Float32Array;
+}
+
+/**
+ * Fills the tile buffers. Buffers are reused between tiles, so a source
+ * must overwrite every element. A source that packs into memory of its
+ * own (e.g. the WASM heap) allocates the buffers and may replace the
+ * arrays in packTile() when that memory moved.
+ */
+export interface MetaISPTileSource {
+  packTile(tile: MetaISPTile, buffers: MetaISPTileBuffers): void | Promise<void>;
+  allocate?(rawLength: number, fullLength: number): MetaISPTileBuffers;
+}
+
+const even = (value: number) => value & ~1;
+
+/**
+ * Tile origins along one axis: a step of size - overlap, with the last tile
+ * moved back to end at the edge instead of running past it
+ */
+function tileOrigins(extent: number, size: number, overlap: number): number[] {
+  if (extent <= size) return [0];
+
+  const step = Math.max(2, even(size - overlap));
+  const origins: number[] = [];
+  for (let origin = 0; origin + size < extent; origin += step) {
+    origins.push(origin);
+  }
+  origins.push(even(extent - size));
+  return origins;
+}
+
+/**
+ * Covers width x height with tiles of at most tileSize, in raster order
+ * (all tiles of a row band before the next band, which TileBlender relies on)
+ */
+export function planTiles(width: number, height: number, tileSize: number, overlap: number): MetaISPTile[] {
+  const size = Math.max(2, even(tileSize));
+  const margin = Math.max(0, Math.min(even(overlap), size - 2));
+  const tileWidth = Math.min(size, even(width));
+  const tileHeight = Math.min(size, even(height));
+
+  const tiles: MetaISPTile[] = [];
+  for (const y of tileOrigins(even(height), tileHeight, margin)) {
+    for (const x of tileOrigins(even(width), tileWidth, margin)) {
+      tiles.push({ x, y, width: tileWidth, height: tileHeight });
+    }
+  }
+  return tiles;
+}
+
+/**
+ * Packs tiles out of full-frame inputs laid out like the single-pass
+ * tensors: raw [4, height/2, width/2] and rawFull [3, height, width]
+ */
+export function fullFrameTileSource(
+  raw: Float32Array,
+  rawFull: Float32Array,
+  fullWidth: number,
+  fullHeight: number
+): MetaISPTileSource {
+  const rawWidth = fullWidth >> 1;
+  const rawPlane = rawWidth * (fullHeight >> 1);
+  const fullPlane = fullWidth * fullHeight;
+
+  return {
+    packTile(tile, { raw: rawTile, rawFull: fullTile }) {
+      const tileRawWidth = tile.width >> 1;
+      const tileRawHeight = tile.height >> 1;
+      for (let c = 0; c < 4; c++) {
+        for (let row = 0; row < tileRawHeight; row++) {
+          const src = c * rawPlane + ((tile.y >> 1) + row) * rawWidth + (tile.x >> 1);
+          const dst = (c * tileRawHeight + row) * tileRawWidth;
+          rawTile.set(raw.subarray(src, src + tileRawWidth), dst);
+        }
+      }
+      for (let c = 0; c < 3; c++) {
+        for (let row = 0; row < tile.height; row++) {
+          const src = c * fullPlane + (tile.y + row) * fullWidth + tile.x;
+          const dst = (c * tile.height + row) * tile.width;
+          fullTile.set(rawFull.subarray(src, src + tile.width), dst);
+        }
+      }
+    },
+  };
+}
+
+/**
+ * Feathering weight along one axis: ramps up over overlap pixels from each
+ * edge that borders another tile, 1 elsewhere. Never 0, so every pixel
+ * keeps a defined weighted mean.
+ */
+function featherWeights(origin: number, size: number, extent: number, overlap: number): Float32Array {
+  const weights = new Float32Array(size).fill(1);
+  if (overlap <= 0) return weights;
+
+  const rampStart = origin > 0;
+  const rampEnd = origin + size < extent;
+  for (let i = 0; i < size; i++) {
+    let weight = 1;
+    if (rampStart) weight = Math.min(weight, (i + 0.5) / overlap);
+    if (rampEnd) weight = Math.min(weight, (size - i - 0.5) / overlap);
+    weights[i] = weight;
+  }
+  return weights;
+}
+
+/**
+ * Accumulates feathered tile outputs ([3, height, width], 0..1) into an
+ * RGBA image. Only one band of tile rows is held in float: rows that no
+ * later tile can reach are converted to 8 bits as soon as a new band
+ * starts, so accumulator memory grows with the width only.
+ */
+export class TileBlender {
+  private readonly image: ImageData;
+  private readonly bandRows: number;
+  // R, G, B and weight sums for rows [bandTop, bandTop + bandRows)
+  private band: Float32Array;
+  private bandTop = 0;
+  private readonly encode: (value: number) => number;
+
+  constructor(
+    private readonly width: number,
+    private readonly height: number,
+    tileSize: number,
+    private readonly overlap: number,
+    srgb = false
+  ) {
+    this.encode = channelEncoder(srgb);
+    this.image = new ImageData(width, height);
+    // One spare row for an odd height, whose last row no tile covers
+    this.bandRows = Math.min(height, Math.max(2, tileSize) + 1);
+    this.band = new Float32Array(this.bandRows * width * 4);
+  }
+
+  add(tile: MetaISPTile, output: Float32Array): void {
+    if (tile.y < this.bandTop) {
+      throw new Error('MetaISP tiles must arrive in raster order');
+    }
+    if (tile.y > this.bandTop) {
+      this.flushRows(tile.y);
+    }
+
+    const wx = featherWeights(tile.x, tile.width, this.width, this.overlap);
+    const wy = featherWeights(tile.y, tile.height, this.height, this.overlap);
+    const plane = tile.width * tile.height;
+
+    for (let row = 0; row < tile.height; row++) {
+      const bandRow = tile.y + row - this.bandTop;
+      let dst = (bandRow * this.width + tile.x) * 4;
+      let src = row * tile.width;
+      for (let col = 0; col < tile.width; col++, dst += 4, src++) {
+        const weight = wx[col] * wy[row];
+        this.band[dst] += output[src] * weight;
+        this.band[dst + 1] += output[plane + src] * weight;
+        this.band[dst + 2] += output[2 * plane + src] * weight;
+        this.band[dst + 3] += weight;
+      }
+    }
+  }
+
+  finish(): ImageData {
+    this.flushRows(this.height);
+    return this.image;
+  }
+
+  // Converts rows [bandTop, until) and moves the rest of the band up
+  private flushRows(until: number): void {
+    const rows = Math.min(until, this.bandTop + this.bandRows) - this.bandTop;
+    const data = this.image.data;
+    const band = this.band;
+
+    let src = 0;
+    let dst = this.bandTop * this.width * 4;
+    for (let i = 0; i < rows * this.width; i++, src += 4, dst += 4) {
+      const weight = band[src + 3] || 1;
+      data[dst] = this.encode(band[src] / weight);
+      data[dst + 1] = this.encode(band[src + 1] / weight);
+      data[dst + 2] = this.encode(band[src + 2] / weight);
+      data[dst + 3] = 255;
+    }
+
+    const kept = rows * this.width * 4;
+    band.copyWithin(0, kept);
+    band.fill(0, band.length - kept);
+    this.bandTop += rows;
+  }
+}
@@ -66,12 +66,49 @@ export interface PhotoMetadata {
   height: number
 }
 
+// Output analysis computed by the WASM module in the pass that produces
+// the RGBA image. Per-channel arrays are R, G, B, luma (clip counts R, G, B).
+export interface ImageAnalysis {
+  histogram: Uint32Array       // 4 x 256 bins of the 8-bit output
+  linearHistogram: Uint32Array // 3 x 256 bins before gamma
+  // Six bit planes of ceil(pixels / 8) bytes: R, G, B at 255, then at 0
+  clipMasks: Uint8Array | null
+  mean: number[]
+  p1: number[]
+  median: number[]
+  p99: number[]
+  highlightClipped: number[]
+  shadowClipped: number[]
+}
+
 // Processed image data
 export interface ProcessedImage {
   data: Uint8ClampedArray
   width: number
   height: number
   metadata: PhotoMetadata
+  // Builds without the analysis pass leave it out
+  analysis?: ImageAnalysis
+  // Full-size output pixels per pixel of a preview, e.g. 2 at half size;
+  // left out at full size
+  scale?: number
+}
+
+// Processed version in the editor history, newest first. Only what
+// changed against the next older entry is stored, plus a small preview;
+// full renders live in a bounded RenderCache.
+export interface HistoryEntry {
+  id: string
+  delta: Partial<EditParams>
+  previewUrl: string | null // Downscaled JPEG data URL
+  width: number             // Size of the full render
+  height: number
+  timestamp: Date
+}
+
+// HistoryEntry with its delta applied to everything older
+export interface HistoryItem extends HistoryEntry {
+  params: EditParams
 }
 
 // Photo in library
@@ -118,10 +155,27 @@ export interface ProcessParams {
   userFlip?: number        // Rotation/flip: 0=none, 3=180, 5=90CCW, 6=90CW
   noAutoBright?: boolean   // Disable auto brightness
   outputTiff?: boolean     // Output TIFF instead of PPM
+  clipMasks?: boolean      // Return per-channel clip bitsets with the image
+  memoryBudget?: number    // Heap bytes a render plans within, 0 = heap maximum
   
   // Color adjustments
   saturation?: number      // -100 to +100
   vibrance?: number        // -100 to +100
+  look?: LookParams        // Basic adjustments applied when the output is copied out
+}
+
+// Basic adjustments of the look stage (setLook()), applied to the linear
+// render through a tone table and a color cube, so changing them
+// re-renders nothing. EditParams units; missing ones are 0.
+export interface LookParams {
+  exposure?: number        // EV
+  contrast?: number        // -100 to +100
+  highlights?: number      // -100 to +100
+  shadows?: number         // -100 to +100
+  whites?: number          // -100 to +100
+  blacks?: number          // -100 to +100
+  saturation?: number      // -100 to +100
+  vibrance?: number        // -100 to +100
 }
 
 // 4-channel RAW data
@@ -140,34 +194,248 @@ export interface BayerData {
   data: Uint16Array
 }
 
+// Unpacked Bayer data and color metadata for a renderer outside LibRaw
+// (the WebGL backend). data is black-subtracted with maximum at 65535.
+export interface ColorPipelineInput {
+  width: number
+  height: number
+  cfa: string         // 2x2 pattern from the top left, e.g. "RGGB"
+  data: Uint16Array
+  camMul: number[]    // As shot multipliers R, G, B, G2
+  preMul: number[]    // Daylight multipliers R, G, B, G2
+  rgbCam: number[]    // Camera to sRGB, 3 rows of 4
+  flip: number
+}
+
+// Unpacked-state snapshot of a file for the persistent cache; size is
+// the number of bytes stream yields
+export interface UnpackedSnapshot {
+  size: number
+  stream: ReadableStream<Uint8Array>
+}
+
 // Thumbnail data
 export interface ThumbnailData {
+  // 'jpeg' as embedded, 'rgba' when binned from the raw data
   format: string
   width: number
   height: number
   data: Uint8Array
 }
 
+// Thumbnail-only read: metadata and the embedded preview, nothing unpacked
+export interface ExtractedThumbnail {
+  metadata: PhotoMetadata
+  thumbnail: ThumbnailData | null
+}
+
+// How much of the pipeline a process() call runs: everything, color
+// conversion on the cached demosaic stage, or nothing when only output
+// parameters (flip, crop, brightness, gamma) changed
+export type PipelineRun = 'full' | 'tail' | 'output'
+
+// Staged pipeline cache state reported by the WASM module. nextRun is
+// what process() would run with the parameters currently set.
+export interface PipelineStats {
+  stage: 'none' | 'unpacked' | 'demosaiced' | 'rendered'
+  demosaicCached: boolean
+  lastRun: PipelineRun
+  nextRun: PipelineRun
+  fullRuns: number
+  tailRuns: number
+  outputRuns: number
+  cacheBytes: number
+}
+
+// Wall-clock milliseconds of the last open, unpack, process and output,
+// as measured inside the WASM module. stages holds the process() stages
+// that took any time, keyed by LibRaw progress stage (e.g. interpolate)
+export interface StageTimings {
+  open: number
+  unpack: number
+  process: number
+  stages: Record<string, number>
+  other: number
+  memImage: number
+  // Output copy into JS, including the copy out of the WASM heap
+  copyOut: number
+  encode: number
+  lastRun: PipelineRun
+}
+
+// Heap use reported by the WASM module, in bytes. Over the budget a render
+// drops the demosaic cache, then frees the raw data after copying it (the
+// next render unpacks again), then renders at half size.
+export interface MemoryStats {
+  heapSize: number
+  heapMax: number
+  allocated: number
+  peakAllocated: number
+  // Peak allocated within each stage of the last render
+  stages: Record<string, number>
+  buffers: {
+    input: number
+    raw: number
+    image: number
+    demosaicCache: number
+    output: number
+    bayer: number
+    encoded: number
+  }
+  budget: number
+  strategy: 'full' | 'noCache' | 'releaseRaw' | 'halfSize'
+  plannedPeak: number
+  // Allocation failures the last render recovered from
+  fallbacks: number
+  rawReleased: boolean
+}
+
+// 16 bits per channel RGBA of a linear render (gamma 1, 1): unsigned
+// 0..65535, or IEEE half floats of 0..1 ready for a HALF_FLOAT texture
+export type LinearFormat = 'uint16' | 'float16'
+
+export interface LinearImage {
+  data: Uint16Array
+  width: number
+  height: number
+  format: LinearFormat
+}
+
+// Per-render options that are not LibRaw parameters
+export interface RenderOptions {
+  // false for throwaway renders (previews) that must not replace the
+  // cached full-quality demosaic stage
+  cacheDemosaic?: boolean
+  // Polled during the render; returning true aborts it with an AbortError
+  isCancelled?: () => boolean
+  // Buffer for the RGBA8 pixels instead of a new one, e.g. a frame ring
+  // slot. Called with their size once it is known; null for a new buffer.
+  output?: (byteLength: number) => Uint8Array | null
+}
+
+// Rectangle of the full-size output image, in pixels after flip and
+// relative to the crop when there is one
+export interface ImageRegion {
+  x: number
+  y: number
+  width: number
+  height: number
+}
+
+// Render of one region. image may be smaller than region (half size);
+// region is what was actually covered, clipped to the image.
+export interface RegionImage {
+  image: ImageData
+  region: ImageRegion
+}
+
+// Conversion of MetaISP output ([3, H, W] floats, 0..1) to RGBA8
+export interface TensorConversionOptions {
+  // Output size, the tensor's own size by default
+  width?: number
+  height?: number
+  // Encode linear output to sRGB
+  srgb?: boolean
+}
+
+// File formats the WASM module encodes for export
+export type ExportFormat = 'jpeg' | 'png' | 'tiff'
+
+export interface EncodeOptions {
+  format: ExportFormat
+  quality?: number // JPEG, 1..100 (90)
+  bits?: 8 | 16    // PNG and TIFF (16)
+}
+
+// Encoded file of a full render
+export interface EncodedImage {
+  data: Uint8Array
+  mimeType: string
+  width: number
+  height: number
+  bits: number
+}
+
 // LibRaw processor interface
 export interface LibRawProcessor {
   loadFile(buffer: ArrayBuffer): Promise<void>
-  process(params: ProcessParams): Promise<ProcessedImage>
+  // Reads the file without materializing it as one ArrayBuffer
+  loadBlob?(file: Blob): Promise<void>
+  process(params: ProcessParams, options?: RenderOptions): Promise<ProcessedImage>
+  // Renders only region; scale <= 0.5 renders it at half size
+  processRegion?(
+    params: ProcessParams,
+    region: ImageRegion,
+    scale: number,
+    options?: RenderOptions
+  ): Promise<{ image: ProcessedImage; region: ImageRegion }>
+  // True when process(params) would skip demosaic, making a preview pointless
+  canReuseDemosaic?(params: ProcessParams): boolean
   getMetadata(): PhotoMetadata
   getThumbnail?(): ThumbnailData | null
+  // Reads metadata and the largest preview without touching the loaded file;
+  // a missing preview, or one smaller than minSize, is binned from the raw data
+  extractThumbnail?(file: Blob, options?: { minSize?: number }): Promise<ExtractedThumbnail>
+  // Demosaic-free preview of the loaded file within maxSide, null when the
+  // build or the sensor cannot bin
+  renderBinnedPreview?(params: ProcessParams, maxSide?: number, options?: RenderOptions): Promise<ProcessedImage | null>
   get4ChannelData?(): ChannelData | null
   getRawBayerData?(): BayerData | null
+  // Snapshot of the unpacked file and its counterpart to loadFile(), which
+  // skips reading and unpacking (optional, newer builds)
+  createUnpackedSnapshot?(): UnpackedSnapshot | null
+  loadUnpackedSnapshot?(snapshot: UnpackedSnapshot): Promise<boolean>
+  // Renders params without the output gamma at 16 bits per channel; null
+  // when the build lacks 16-bit output
+  processLinear?(params: ProcessParams, format?: LinearFormat, options?: RenderOptions): Promise<LinearImage | null>
+  // Renders params and encodes the result in the module, null when the
+  // build lacks the encoder for options.format
+  encode?(params: ProcessParams, options: EncodeOptions, renderOptions?: RenderOptions): Promise<EncodedImage | null>
+  // WASM heap in bytes, null when unknown
+  getHeapSize?(): number | null
+  // Heap use and the memory strategy of the last render, null when unknown
+  getMemoryStats?(): MemoryStats | null
+  // Native CHW float to RGBA8 conversion, null when the build lacks it
+  convertTensor?(
+    tensor: Float32Array,
+    srcWidth: number,
+    srcHeight: number,
+    options: TensorConversionOptions
+  ): { data: Uint8ClampedArray; width: number; height: number } | null
   dispose(): void
 }
 
 // Worker message types
+// 'cancel' ({ seq }) marks process requests with a lower seq as out of
+// date; it has no response. 'init' ({ variant, wasmModule, backend }) is
+// optional and must come first; it picks the build, supplies precompiled
+// wasm and chooses the CPU or WebGL pipeline.
+// 'get-thumbnail-only' ({ file, minSize }) answers 'thumbnail' with an
+// ExtractedThumbnail and leaves the loaded file alone; binned previews
+// come back as JPEG when the worker can encode them. 'process-region'
+// ({ params, region, scale, seq }) answers 'region' with the tile and the
+// region it covers; it shares the seq (and 'cancel') of 'process'.
+// 'convert-tensor' ({ tensor, srcWidth, srcHeight, options }) answers
+// 'converted' with RGBA8 { data, width, height }; it needs no loaded file.
+// 'encode' ({ params, options }) answers 'encoded' with an EncodedImage,
+// or null when the build cannot encode options.format.
+// 'get-memory-stats' answers 'memory-stats' with MemoryStats or null.
+// 'process-linear' ({ params, format }) answers 'linear' with a LinearImage,
+// or null when the build has no 16-bit output.
 export interface WorkerMessage {
-  type: 'load' | 'process' | 'dispose' | 'get-thumbnail'
+  type: 'init' | 'load' | 'process' | 'process-region' | 'process-linear' | 'cancel' | 'dispose' | 'get-thumbnail' | 'get-thumbnail-only' | 'get-heap-size' | 'get-memory-stats' | 'convert-tensor' | 'encode'
   id: string
   data?: any
 }
 
+// 'process' with data.progressive answers with a smaller 'preview' first,
+// with its data.scale, then 'processed'. 'preview' and 'region' carry data.frame (a RingFrame)
+// instead of data.data when the worker rendered them into its frame ring. 'cancelled' means a newer request superseded the render
+// (data.partial: a preview was delivered before the abort). 'loaded' has
+// { metadata, cached, preview }: cached when the file came from the
+// unpacked cache, with the JPEG Blob of its last render as preview.
 export interface WorkerResponse {
-  type: 'loaded' | 'processed' | 'disposed' | 'error' | 'thumbnail'
+  type: 'initialized' | 'loaded' | 'processed' | 'preview' | 'region' | 'linear' | 'cancelled' | 'disposed' | 'error' | 'thumbnail' | 'heap-size' | 'memory-stats' | 'converted' | 'encoded'
   id: string
   data?: any
   error?: string
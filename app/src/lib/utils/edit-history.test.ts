@@ -0,0 +1,84 @@
+import { describe, it, expect } from 'vitest'
+import { HistoryEntry } from '@/lib/types'
+import { createTestEditParams } from '@/test/utils'
+import { RenderCache, paramsDelta, resolveHistory } from './edit-history'
+
+function entry(id: string, delta: HistoryEntry['delta']): HistoryEntry {
+  return { id, delta, previewUrl: null, width: 10, height: 10, timestamp: new Date() }
+}
+
+describe('edit-history', () => {
+  describe('paramsDelta', () => {
+    it('should keep only changed parameters', () => {
+      const base = createTestEditParams({ cropArea: { x1: 0, y1: 0, x2: 20, y2: 20 } })
+      const next = { ...base, exposure: 1.5, cropArea: { x1: 0, y1: 0, x2: 10, y2: 10 } }
+      
+      expect(paramsDelta(base, next)).toEqual({ exposure: 1.5, cropArea: { x1: 0, y1: 0, x2: 10, y2: 10 } })
+      // Objects compare by value
+      expect(paramsDelta(base, { ...base, cropArea: { x1: 0, y1: 0, x2: 20, y2: 20 } })).toEqual({})
+    })
+
+    it('should store everything for the first version', () => {
+      const params = createTestEditParams({ contrast: 20 })
+      expect(paramsDelta(null, params)).toEqual(params)
+    })
+  })
+
+  describe('resolveHistory', () => {
+    it('should apply deltas from the oldest version to the newest', () => {
+      const first = createTestEditParams()
+      const entries = [
+        entry('3', { contrast: 40 }),
+        entry('2', { exposure: 1 }),
+        entry('1', first),
+      ]
+      
+      const items = resolveHistory(entries)
+      expect(items[2].params).toEqual(first)
+      expect(items[1].params).toEqual({ ...first, exposure: 1 })
+      expect(items[0].params).toEqual({ ...first, exposure: 1, contrast: 40 })
+      expect(items[0].id).toBe('3')
+    })
+  })
+
+  describe('RenderCache', () => {
+    // 100 bytes each
+    const image = () => new ImageData(5, 5)
+
+    it('should evict the least recently used renders over budget', () => {
+      const cache = new RenderCache(250)
+      const a = image()
+      cache.set('a', a)
+      cache.set('b', image())
+      // Touching a makes b the oldest
+      expect(cache.get('a')).toBe(a)
+      cache.set('c', image())
+      
+      expect(cache.get('b')).toBeNull()
+      expect(cache.get('a')).toBe(a)
+      expect(cache.size).toBe(2)
+    })
+
+    it('should keep the newest render even over budget', () => {
+      const cache = new RenderCache(50)
+      cache.set('a', image())
+      cache.set('b', image())
+      
+      expect(cache.get('a')).toBeNull()
+      expect(cache.get('b')).not.toBeNull()
+    })
+
+    it('should account for replaced and deleted renders', () => {
+      const cache = new RenderCache(200)
+      cache.set('a', image())
+      cache.set('a', image())
+      cache.set('b', image())
+      expect(cache.size).toBe(2)
+      
+      cache.delete('a')
+      cache.set('c', image())
+      expect(cache.get('b')).not.toBeNull()
+      expect(cache.size).toBe(2)
+    })
+  })
+})
@@ -0,0 +1,77 @@
+import { EditParams, HistoryEntry, HistoryItem } from '@/lib/types'
+
+// Full renders kept for instant restore and comparison: about four at 15 MP.
+// Evicted ones are rendered again from the worker's cached demosaic.
+export const RENDER_CACHE_BYTES = 256 * 1024 * 1024
+// Longest side of the JPEG stored with each history entry
+export const HISTORY_PREVIEW_SIZE = 512
+
+// Parameters of next that differ from base (all of them without a base)
+export function paramsDelta(base: EditParams | null, next: EditParams): Partial<EditParams> {
+  if (!base) return { ...next }
+
+  const delta: Partial<EditParams> = {}
+  for (const key of Object.keys(next) as (keyof EditParams)[]) {
+    if (JSON.stringify(next[key]) !== JSON.stringify(base[key])) {
+      ;(delta as Record<string, unknown>)[key] = next[key]
+    }
+  }
+  return delta
+}
+
+// Applies the deltas from the oldest entry (last) to the newest (first)
+export function resolveHistory(entries: HistoryEntry[]): HistoryItem[] {
+  const items: HistoryItem[] = new Array(entries.length)
+  let params: EditParams | null = null
+  for (let i = entries.length - 1; i >= 0; i--) {
+    params = { ...params, ...entries[i].delta } as EditParams
+    items[i] = { ...entries[i], params }
+  }
+  return items
+}
+
+// Least recently used cache of full renders by history id, bounded by
+// pixel bytes
+export class RenderCache {
+  private readonly images = new Map<string, ImageData>()
+  private bytes = 0
+
+  constructor(private readonly maxBytes = RENDER_CACHE_BYTES) {}
+
+  get size(): number {
+    return this.images.size
+  }
+
+  get(id: string): ImageData | null {
+    const image = this.images.get(id)
+    if (!image) return null
+    // Map order is the recency order
+    this.images.delete(id)
+    this.images.set(id, image)
+    return image
+  }
+
+  // The newest render always stays, even when it alone exceeds the budget
+  set(id: string, image: ImageData): void {
+    this.delete(id)
+    this.images.set(id, image)
+    this.bytes += image.data.byteLength
+    for (const [oldest, evicted] of this.images) {
+      if (this.bytes <= this.maxBytes || oldest === id) break
+      this.images.delete(oldest)
+      this.bytes -= evicted.data.byteLength
+    }
+  }
+
+  delete(id: string): void {
+    const image = this.images.get(id)
+    if (!image) return
+    this.images.delete(id)
+    this.bytes -= image.data.byteLength
+  }
+
+  clear(): void {
+    this.images.clear()
+    this.bytes = 0
+  }
+}
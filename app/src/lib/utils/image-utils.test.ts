@@ -1,5 +1,5 @@
 import { describe, it, expect, beforeEach, vi, Mock } from 'vitest'
-import { imageDataToJpeg, jpegToImageData } from './image-utils'
+import { imageDataToBlob, imageDataToJpeg, jpegToImageData, rgbToRgba } from './image-utils'
 
 // Mock canvas and related APIs
 const mockCanvas = {
@@ -170,6 +170,19 @@ describe('image-utils', () => {
       await expect(imageDataToJpeg(imageData)).rejects.toThrow('Failed to convert to data URL')
     })
 
+    it('should scale down to maxSide', async () => {
+      const imageData = new ImageData(400, 200)
+      
+      mockCanvas.toBlob.mockImplementation((callback: BlobCallback) => {
+        callback(new Blob(['small jpeg data'], { type: 'image/jpeg' }))
+      })
+      
+      await imageDataToJpeg(imageData, 100)
+      
+      expect(mockContext.putImageData).toHaveBeenCalledWith(imageData, 0, 0)
+      expect(mockContext.drawImage).toHaveBeenCalledWith(mockCanvas, 0, 0, 100, 50)
+    })
+
     it('should handle large ImageData', async () => {
       const largeImageData = new ImageData(4000, 3000)
       
@@ -186,6 +199,25 @@ describe('image-utils', () => {
     })
   })
 
+  describe('imageDataToBlob', () => {
+    it('should encode with the requested type', async () => {
+      const imageData = new ImageData(10, 10)
+      const png = new Blob(['mock png data'], { type: 'image/png' })
+      mockCanvas.toBlob.mockImplementation((callback: BlobCallback, type: string) => {
+        expect(type).toBe('image/png')
+        callback(png)
+      })
+      
+      await expect(imageDataToBlob(imageData, 'image/png')).resolves.toBe(png)
+    })
+
+    it('should name the type when encoding fails', async () => {
+      mockCanvas.toBlob.mockImplementation((callback: BlobCallback) => callback(null))
+      
+      await expect(imageDataToBlob(new ImageData(10, 10), 'image/png')).rejects.toThrow('Failed to convert to PNG')
+    })
+  })
+
   describe('jpegToImageData', () => {
     it('should convert JPEG data URL to ImageData', async () => {
       const jpegDataUrl = 'data:image/jpeg;base64,mockbase64data'
@@ -285,4 +317,27 @@ describe('image-utils', () => {
       expect(result).toBe(mockImageData)
     })
   })
-})
\ No newline at end of file
+
+  describe('rgbToRgba', () => {
+    it('should expand RGB pixels with opaque alpha', () => {
+      const rgb = new Uint8Array([255, 0, 0, 0, 128, 0, 1, 2, 3])
+      const rgba = rgbToRgba(rgb, 3)
+
+      expect(Array.from(rgba)).toEqual([255, 0, 0, 255, 0, 128, 0, 255, 1, 2, 3, 255])
+    })
+
+    it('should write into a provided unaligned buffer', () => {
+      const backing = new Uint8ClampedArray(9)
+      const out = new Uint8ClampedArray(backing.buffer, 1, 8)
+
+      rgbToRgba([10, 20, 30, 40, 50, 60], 2, out)
+
+      expect(Array.from(out)).toEqual([10, 20, 30, 255, 40, 50, 60, 255])
+      expect(backing[0]).toBe(0)
+    })
+
+    it('should reject a too small output buffer', () => {
+      expect(() => rgbToRgba([1, 2, 3], 1, new Uint8ClampedArray(3))).toThrow('Output buffer too small')
+    })
+  })
+})
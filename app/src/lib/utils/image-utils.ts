@@ -1,34 +1,93 @@
-export async function imageDataToJpeg(imageData: ImageData): Promise<string> {
-  // Create a canvas to convert ImageData to JPEG
+const LITTLE_ENDIAN = new Uint8Array(new Uint32Array([1]).buffer)[0] === 1
+
+// Expand packed RGB8 to RGBA8 with opaque alpha. Writes one 32-bit word per
+// pixel when the output is aligned and the platform is little-endian.
+export function rgbToRgba(
+  rgb: ArrayLike<number>,
+  pixelCount: number,
+  out: Uint8ClampedArray = new Uint8ClampedArray(pixelCount * 4)
+): Uint8ClampedArray {
+  if (out.length < pixelCount * 4) {
+    throw new Error('Output buffer too small')
+  }
+
+  if (LITTLE_ENDIAN && out.byteOffset % 4 === 0) {
+    const out32 = new Uint32Array(out.buffer, out.byteOffset, pixelCount)
+    for (let i = 0, j = 0; i < pixelCount; i++, j += 3) {
+      out32[i] = 0xff000000 | (rgb[j + 2] << 16) | (rgb[j + 1] << 8) | rgb[j]
+    }
+  } else {
+    for (let i = 0, j = 0, k = 0; i < pixelCount; i++, j += 3, k += 4) {
+      out[k] = rgb[j]
+      out[k + 1] = rgb[j + 1]
+      out[k + 2] = rgb[j + 2]
+      out[k + 3] = 255
+    }
+  }
+
+  return out
+}
+
+// Canvas-encoded file of imageData, e.g. when the WASM build has no
+// encoder. maxSide limits the longest side; larger images are scaled down.
+export async function imageDataToBlob(
+  imageData: ImageData,
+  type = 'image/jpeg',
+  quality = 0.9,
+  maxSide = Infinity
+): Promise<Blob> {
+  const scale = Math.min(1, maxSide / Math.max(imageData.width, imageData.height))
+  const width = Math.max(1, Math.round(imageData.width * scale))
+  const height = Math.max(1, Math.round(imageData.height * scale))
+  
   const canvas = document.createElement('canvas')
-  canvas.width = imageData.width
-  canvas.height = imageData.height
+  canvas.width = width
+  canvas.height = height
   
   const ctx = canvas.getContext('2d')
   if (!ctx) throw new Error('Failed to get canvas context')
   
-  // Draw the ImageData onto the canvas
-  ctx.putImageData(imageData, 0, 0)
+  if (scale < 1) {
+    // putImageData() does not scale; draw through a full-size canvas
+    const source = document.createElement('canvas')
+    source.width = imageData.width
+    source.height = imageData.height
+    const sourceCtx = source.getContext('2d')
+    if (!sourceCtx) throw new Error('Failed to get canvas context')
+    sourceCtx.putImageData(imageData, 0, 0)
+    ctx.drawImage(source, 0, 0, width, height)
+  } else {
+    // Draw the ImageData onto the canvas
+    ctx.putImageData(imageData, 0, 0)
+  }
   
-  // Convert to JPEG data URL
   return new Promise((resolve, reject) => {
     canvas.toBlob((blob) => {
-      if (!blob) {
-        reject(new Error('Failed to convert to JPEG'))
-        return
+      if (blob) {
+        resolve(blob)
+      } else {
+        reject(new Error(`Failed to convert to ${type.replace('image/', '').toUpperCase()}`))
       }
-      
-      const reader = new FileReader()
-      reader.onloadend = () => {
-        if (typeof reader.result === 'string') {
-          resolve(reader.result)
-        } else {
-          reject(new Error('Failed to convert to data URL'))
-        }
+    }, type, quality)
+  })
+}
+
+// maxSide limits the longest side of the JPEG; larger images are scaled down
+export async function imageDataToJpeg(imageData: ImageData, maxSide = Infinity): Promise<string> {
+  const blob = await imageDataToBlob(imageData, 'image/jpeg', 0.9, maxSide)
+  
+  // Convert to JPEG data URL
+  return new Promise((resolve, reject) => {
+    const reader = new FileReader()
+    reader.onloadend = () => {
+      if (typeof reader.result === 'string') {
+        resolve(reader.result)
+      } else {
+        reject(new Error('Failed to convert to data URL'))
       }
-      reader.onerror = reject
-      reader.readAsDataURL(blob)
-    }, 'image/jpeg', 0.9)
+    }
+    reader.onerror = reject
+    reader.readAsDataURL(blob)
   })
 }
 
@@ -24,6 +24,32 @@ if [ -f "$LIBRAW_WASM_DIR/libraw.wasm" ]; then
     echo "Copied libraw.wasm"
 fi
 
+# SIMD128 build (selected at runtime when the browser supports it). The
+# lazy split build replaces it when present.
+SIMD_DIR="$LIBRAW_WASM_DIR"
+if [ -f "$LIBRAW_WASM_DIR/split/libraw-simd.deferred.wasm" ]; then
+    SIMD_DIR="$LIBRAW_WASM_DIR/split"
+    cp "$SIMD_DIR/libraw-simd.deferred.wasm" "$APP_WASM_DIR/"
+    echo "Copied split libraw-simd.deferred.wasm"
+else
+    rm -f "$APP_WASM_DIR/libraw-simd.deferred.wasm"
+fi
+
+for file in libraw-simd.js libraw-simd.wasm; do
+    if [ -f "$SIMD_DIR/$file" ]; then
+        cp "$SIMD_DIR/$file" "$APP_WASM_DIR/"
+        echo "Copied $file"
+    fi
+done
+
+# Multithreaded build (loaded only when the page is crossOriginIsolated)
+for file in libraw-mt.js libraw-mt.wasm; do
+    if [ -f "$LIBRAW_WASM_DIR/$file" ]; then
+        cp "$LIBRAW_WASM_DIR/$file" "$APP_WASM_DIR/"
+        echo "Copied $file"
+    fi
+done
+
 if [ -f "$LIBRAW_WASM_DIR/libraw-node.js" ]; then
     cp "$LIBRAW_WASM_DIR/libraw-node.js" "$APP_WASM_DIR/"
     echo "Copied libraw-node.js"